@@ -0,0 +1,66 @@
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+/*
+ * Small helpers shared by the host benchmarks: a monotonic nanosecond clock
+ * and latency percentiles.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace BenchUtil {
+
+inline uint64_t nanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Percentiles {
+    double p50;
+    double p99;
+    double p999;
+    double max;
+};
+
+// Percentiles of samples in nanoseconds, reported in microseconds (sorts the samples)
+inline Percentiles percentiles(std::vector<uint64_t> &samples) {
+    Percentiles result = {0, 0, 0, 0};
+    if (samples.empty()) {
+        return result;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t last = samples.size() - 1;
+    result.p50 = samples[last * 50 / 100] / 1000.0;
+    result.p99 = samples[last * 99 / 100] / 1000.0;
+    result.p999 = samples[last * 999 / 1000] / 1000.0;
+    result.max = samples[last] / 1000.0;
+    return result;
+}
+
+// "--name value" style option lookup with a default
+inline unsigned long option(int argc, char **argv, const char *name, unsigned long fallback) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return strtoul(argv[i + 1], nullptr, 10);
+        }
+    }
+    return fallback;
+}
+
+inline bool flag(int argc, char **argv, const char *name) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace BenchUtil
+
+#endif // BENCHUTIL_H
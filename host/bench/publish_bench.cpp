@@ -0,0 +1,179 @@
+/*
+ * Publish path benchmark against the loopback broker.
+ *
+ * For every combination of QoS, topic length and payload size it times each
+ * MqttManager::sendMessage() call and reports the call rate, payload
+ * throughput, p50/p99/p99.9/max call latency and the rate at which the
+ * broker actually received the messages. QoS 1 and 2 acknowledgements are
+ * handled by poll() with deferred dispatch on, after every call and outside
+ * the timed region, the way loop() would handle them on the device. While the
+ * in-flight window is full, the next QoS 1/2 call waits (untimed) for an
+ * acknowledgement, so every message is published right away, none is dropped
+ * and msg/s is the acknowledged rate the window allows.
+ *
+ * The same source is built once per logging configuration
+ * (mqttmanager_publish_bench, _serial_log and _deferred_log) to show what
+ * Serial output costs on the publish path. Serial is paced like a 115200 baud
+ * UART and written to /dev/null; pass --no-uart-pacing to disable the pacing.
+ * The deferred variant drains its log buffer after every call, outside the
+ * timed region, so its latency columns show the cost left on the publish path
+ * while msg/s still includes the drain.
+ *
+ *     ./mqttmanager_publish_bench [--messages N] [--no-uart-pacing]
+ */
+
+#include <Arduino.h>
+#include <MqttLog.h>
+#include <MqttManager.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "BenchUtil.h"
+#include "LoopbackBroker.h"
+
+namespace {
+
+#if MQTTMANAGER_LOG_LEVEL == MQTTMANAGER_LOG_NONE
+const char *logMode = "none";
+const size_t defaultMessages = 20000;
+#elif defined(MQTTMANAGER_LOG_DEFERRED)
+const char *logMode = "deferred";
+const size_t defaultMessages = 500; // Every message is logged and drained at UART speed
+#else
+const char *logMode = "serial";
+const size_t defaultMessages = 500;
+#endif
+
+struct Case {
+    uint8_t qos;
+    size_t topicLength;
+    size_t payloadLength;
+};
+
+// Topic of exactly length characters, shaped like the ones in examples/example.cpp
+std::string makeTopic(size_t length) {
+    std::string topic = "korngva/sound_monitor/first_floor/sound_state";
+    if (length <= topic.size()) {
+        topic.resize(length);
+    } else {
+        while (topic.size() < length) {
+            topic += topic.size() % 16 == 15 ? '/' : 'x';
+        }
+    }
+    if (!topic.empty() && topic[topic.size() - 1] == '/') {
+        topic[topic.size() - 1] = 'x';
+    }
+    return topic;
+}
+
+bool waitForBroker(MqttManager &manager, LoopbackBroker &broker, unsigned long target, unsigned long timeoutMs) {
+    unsigned long started = millis();
+    while (broker.publishCount() < target) {
+        if (millis() - started >= timeoutMs) {
+            return false;
+        }
+        manager.poll(); // Acknowledgements free in-flight slots and let the outbox drain
+        delay(1);
+    }
+    return true;
+}
+
+// Poll until a QoS 1/2 message fits in the in-flight window instead of going to the outbox
+void waitForRoom(MqttManager &manager, uint8_t qos) {
+    while (qos > 0 && manager.inflightCount() >= MQTTMANAGER_INFLIGHT_SIZE) {
+        manager.poll();
+    }
+}
+
+void runCase(MqttManager &manager, LoopbackBroker &broker, const Case &benchCase, size_t messages) {
+    std::string topic = makeTopic(benchCase.topicLength);
+    std::string payload(benchCase.payloadLength, 'a');
+    MqttPublishOptions options(benchCase.qos);
+    std::vector<uint64_t> samples;
+    samples.reserve(messages);
+
+    unsigned long baseline = broker.publishCount() + 200;
+    for (size_t i = 0; i < 200; i++) { // Warm-up
+        waitForRoom(manager, benchCase.qos);
+        manager.sendMessage(topic.c_str(), payload.c_str(), options);
+        manager.poll();
+        mqttLogDrain();
+    }
+    waitForBroker(manager, broker, baseline, 10000);
+
+    uint64_t started = BenchUtil::nanos();
+    for (size_t i = 0; i < messages; i++) {
+        waitForRoom(manager, benchCase.qos);
+        uint64_t before = BenchUtil::nanos();
+        manager.sendMessage(topic.c_str(), payload.c_str(), options);
+        samples.push_back(BenchUtil::nanos() - before);
+        manager.poll(); // Off the measured path, like the rest of loop()
+        mqttLogDrain();
+    }
+    uint64_t sent = BenchUtil::nanos();
+    bool delivered = waitForBroker(manager, broker, baseline + messages, 30000);
+    uint64_t received = BenchUtil::nanos();
+
+    double sendSeconds = (sent - started) / 1e9;
+    double receiveSeconds = (received - started) / 1e9;
+    BenchUtil::Percentiles latency = BenchUtil::percentiles(samples);
+    printf("%3u %6zu %8zu %12.0f %10.2f %9.2f %9.2f %9.2f %9.2f %12.0f%s\n", benchCase.qos,
+           benchCase.topicLength, benchCase.payloadLength, messages / sendSeconds,
+           messages * benchCase.payloadLength / sendSeconds / 1e6, latency.p50, latency.p99, latency.p999,
+           latency.max, delivered ? messages / receiveSeconds : 0.0, delivered ? "" : " (incomplete)");
+    fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t messages = BenchUtil::option(argc, argv, "--messages", defaultMessages);
+
+    FILE *devNull = fopen("/dev/null", "w");
+    Serial.setOutput(devNull ? devNull : stdout);
+    Serial.begin(115200);
+    Serial.setBaudPacing(!BenchUtil::flag(argc, argv, "--no-uart-pacing"));
+
+    LoopbackBroker broker;
+    uint16_t port = broker.start();
+    if (port == 0) {
+        fprintf(stderr, "Could not start the loopback broker\n");
+        return 1;
+    }
+
+    MqttManager manager;
+    manager.setDeferredDispatch(true); // QoS 1/2 acknowledgements are handled by poll() on this thread
+    manager.setServer("127.0.0.1", port);
+    manager.setLwt("bench/status");
+    manager.connect();
+    unsigned long started = millis();
+    while (!manager.isConnected() && millis() - started < 5000) {
+        manager.poll();
+        delay(1);
+    }
+    if (!manager.isConnected()) {
+        fprintf(stderr, "Could not connect to the loopback broker\n");
+        return 1;
+    }
+
+    const uint8_t qosLevels[] = {0, 1, 2};
+    const size_t topicLengths[] = {16, 45, 128};
+    const size_t payloadLengths[] = {16, 256, 1024, 4096};
+
+    printf("log mode: %s, %zu messages per case\n", logMode, messages);
+    printf("qos  topic  payload        msg/s       MB/s   p50(us)   p99(us)  p999(us)   max(us)  delivered/s\n");
+    for (uint8_t qos : qosLevels) {
+        for (size_t topicLength : topicLengths) {
+            for (size_t payloadLength : payloadLengths) {
+                Case benchCase = {qos, topicLength, payloadLength};
+                runCase(manager, broker, benchCase, messages);
+            }
+        }
+    }
+
+    if (mqttLogDropped()) {
+        printf("deferred log lines dropped: %lu\n", mqttLogDropped());
+    }
+    broker.stop();
+    return 0;
+}
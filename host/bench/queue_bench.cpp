@@ -0,0 +1,224 @@
+/*
+ * Multi-producer publish queue benchmark.
+ *
+ * Part 1 pits MqttMpscQueue against a mutex-protected ring of the same size:
+ * 1..8 producer threads push messages while one consumer thread pops them.
+ * It reports the overall rate, the p50/p99/p99.9/max time a push() call
+ * takes (retries on a full queue included) and how often producers found the
+ * queue full.
+ *
+ * Part 2 runs the real path: producer threads call
+ * MqttManager::queueMessage() while the main thread calls poll(), publishing
+ * to the loopback broker. Producers retry a refused message after yielding,
+ * like a sensor task would; it reports the queueing and delivery rates and
+ * how many calls were refused because the queue was full.
+ *
+ * Results depend heavily on the number of cores; with fewer cores than
+ * threads they mostly show how each queue behaves when a holder is preempted.
+ *
+ *     ./mqttmanager_queue_bench [--messages N]
+ */
+
+#include <Arduino.h>
+#include <MqttManager.h>
+#include <MqttMpscQueue.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BenchUtil.h"
+#include "LoopbackBroker.h"
+
+namespace {
+
+const size_t queueSize = 1024;
+const size_t threadCounts[] = {1, 2, 4, 8};
+
+// What a producer hands over: the same shape the manager queues
+typedef MqttStoredMessage<MQTTMANAGER_MAX_TOPIC_LEN, MQTTMANAGER_MAX_PAYLOAD_LEN> Item;
+
+// Baseline: the same fill-in-place interface around a ring guarded by one mutex
+template <typename T, size_t Capacity>
+class MutexQueue {
+public:
+    MutexQueue() : head(0), count(0) {}
+
+    template <typename Fill>
+    bool push(Fill fill) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == Capacity) {
+            return false;
+        }
+        fill(items[(head + count) % Capacity]);
+        count++;
+        return true;
+    }
+
+    template <typename Visit>
+    bool pop(Visit visit) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == 0) {
+            return false;
+        }
+        visit(items[head]);
+        head = (head + 1) % Capacity;
+        count--;
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    T items[Capacity];
+    size_t head;
+    size_t count;
+};
+
+template <typename Queue>
+void runQueue(const char *name, size_t producers, size_t messages) {
+    std::unique_ptr<Queue> queue(new Queue());
+    const char *topic = "korngva/sound_monitor/first_floor/sound_state";
+    const char payload[32] = "0123456789abcdef0123456789abcde";
+    MqttPublishOptions options;
+    size_t perProducer = messages / producers;
+    size_t total = perProducer * producers;
+
+    std::vector<std::vector<uint64_t> > samples(producers);
+    std::atomic<unsigned long> fullCount(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; p++) {
+        samples[p].reserve(perProducer);
+        threads.emplace_back([&, p]() {
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            for (size_t i = 0; i < perProducer; i++) {
+                uint64_t before = BenchUtil::nanos();
+                while (!queue->push([&](Item &item) { item.assign(topic, payload, sizeof(payload), options, i); })) {
+                    fullCount.fetch_add(1, std::memory_order_relaxed);
+                    std::this_thread::yield();
+                }
+                samples[p].push_back(BenchUtil::nanos() - before);
+            }
+        });
+    }
+
+    size_t received = 0;
+    size_t bytes = 0;
+    go.store(true);
+    uint64_t started = BenchUtil::nanos();
+    while (received < total) {
+        if (queue->pop([&](Item &item) { bytes += item.length; })) {
+            received++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    uint64_t elapsed = BenchUtil::nanos() - started;
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    std::vector<uint64_t> all;
+    all.reserve(total);
+    for (const std::vector<uint64_t> &producerSamples : samples) {
+        all.insert(all.end(), producerSamples.begin(), producerSamples.end());
+    }
+    BenchUtil::Percentiles latency = BenchUtil::percentiles(all);
+    printf("%-8s %9zu %12.0f %9.2f %9.2f %9.2f %9.2f %10lu\n", name, producers, total / (elapsed / 1e9),
+           latency.p50, latency.p99, latency.p999, latency.max, fullCount.load());
+    fflush(stdout);
+}
+
+void runManager(MqttManager &manager, LoopbackBroker &broker, size_t producers, size_t messages) {
+    size_t perProducer = messages / producers;
+    size_t total = perProducer * producers;
+    unsigned long baseline = broker.publishCount();
+    unsigned long droppedBefore = manager.queueDropped();
+
+    std::atomic<size_t> finished(0);
+    std::vector<std::thread> threads;
+    uint64_t started = BenchUtil::nanos();
+    for (size_t p = 0; p < producers; p++) {
+        threads.emplace_back([&, p]() {
+            char topic[48];
+            snprintf(topic, sizeof(topic), "bench/producer/%zu", p);
+            for (size_t i = 0; i < perProducer; i++) {
+                while (!manager.queueMessage(topic, "0123456789abcdef0123456789abcde").ok()) {
+                    std::this_thread::yield(); // Queue full: let poll() catch up
+                }
+            }
+            finished.fetch_add(1);
+        });
+    }
+    while (finished.load() < producers) {
+        if (manager.poll() == 0) { // The single task that writes to the client
+            std::this_thread::yield();
+        }
+    }
+    manager.poll();
+    uint64_t queued = BenchUtil::nanos();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    unsigned long dropped = manager.queueDropped() - droppedBefore;
+    unsigned long expected = baseline + total;
+    unsigned long waitStarted = millis();
+    while (broker.publishCount() < expected && millis() - waitStarted < 30000) {
+        delay(1);
+    }
+    uint64_t delivered = BenchUtil::nanos();
+    printf("%9zu %12.0f %12.0f %10lu\n", producers, total / ((queued - started) / 1e9),
+           (broker.publishCount() - baseline) / ((delivered - started) / 1e9), dropped);
+    fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t messages = BenchUtil::option(argc, argv, "--messages", 200000);
+
+    FILE *devNull = fopen("/dev/null", "w");
+    Serial.setOutput(devNull ? devNull : stdout);
+
+    printf("%u hardware threads, %zu messages per run, queue of %zu\n", std::thread::hardware_concurrency(),
+           messages, queueSize);
+    printf("queue    producers        msg/s   p50(us)   p99(us)  p999(us)   max(us)  full hits\n");
+    for (size_t producers : threadCounts) {
+        runQueue<MqttMpscQueue<Item, queueSize> >("mpsc", producers, messages);
+        runQueue<MutexQueue<Item, queueSize> >("mutex", producers, messages);
+    }
+
+    LoopbackBroker broker;
+    uint16_t port = broker.start();
+    if (port == 0) {
+        fprintf(stderr, "Could not start the loopback broker\n");
+        return 1;
+    }
+    MqttManager manager;
+    manager.setServer("127.0.0.1", port);
+    manager.setLwt("bench/status");
+    manager.setDefaultPublishOptions(MqttPublishOptions(0, false));
+    manager.connect();
+    unsigned long started = millis();
+    while (!manager.isConnected() && millis() - started < 5000) {
+        delay(1);
+    }
+    if (!manager.isConnected()) {
+        fprintf(stderr, "Could not connect to the loopback broker\n");
+        return 1;
+    }
+
+    size_t managerMessages = messages / 10;
+    printf("\nqueueMessage() -> poll() -> broker, %zu messages per run, queue of %d\n", managerMessages,
+           MQTTMANAGER_PUBLISH_QUEUE_SIZE);
+    printf("producers     queued/s  delivered/s    refused\n");
+    for (size_t producers : threadCounts) {
+        runManager(manager, broker, producers, managerMessages);
+    }
+    broker.stop();
+    return 0;
+}
@@ -0,0 +1,513 @@
+#include "LoopbackBroker.h"
+#include "MqttWire.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+
+namespace {
+
+const size_t historyLimit = 4096; // Messages kept for waitForMessage()
+
+} // namespace
+
+LoopbackBroker::LoopbackBroker()
+    : listenSock(-1),
+      listenPort(0),
+      running(false),
+      acceptConnections(true),
+      publishes(0),
+      bytes(0),
+      connects(0)
+{
+}
+
+LoopbackBroker::~LoopbackBroker() {
+    stop();
+}
+
+uint16_t LoopbackBroker::start(uint16_t port) {
+    if (running) {
+        return listenPort;
+    }
+
+    listenSock = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenSock < 0) {
+        return 0;
+    }
+    int reuse = 1;
+    setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    socklen_t length = sizeof(address);
+    if (bind(listenSock, (sockaddr *)&address, sizeof(address)) != 0 || listen(listenSock, 128) != 0 ||
+        getsockname(listenSock, (sockaddr *)&address, &length) != 0) {
+        close(listenSock);
+        listenSock = -1;
+        return 0;
+    }
+
+    listenPort = ntohs(address.sin_port);
+    running = true;
+    acceptThread = std::thread(&LoopbackBroker::acceptLoop, this);
+    return listenPort;
+}
+
+void LoopbackBroker::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    acceptThread.join();
+    close(listenSock);
+    listenSock = -1;
+
+    std::vector<std::shared_ptr<Session> > remaining;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining.swap(sessions);
+    }
+    for (auto &session : remaining) {
+        cut(session);
+    }
+    for (auto &session : remaining) {
+        session->thread.join();
+    }
+}
+
+void LoopbackBroker::onPublish(PublishObserver observer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    observers.push_back(observer);
+}
+
+void LoopbackBroker::setAcceptConnections(bool accept) {
+    acceptConnections = accept;
+}
+
+bool LoopbackBroker::dropClient(const std::string &clientId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &session : sessions) {
+        if (session->connected && session->clientId == clientId && !session->finished) {
+            cut(session);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t LoopbackBroker::dropAllClients() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t dropped = 0;
+    for (auto &session : sessions) {
+        if (!session->finished) {
+            cut(session);
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
+bool LoopbackBroker::retained(const std::string &topic, std::string *payload) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = retainedMessages.find(topic);
+    if (found == retainedMessages.end()) {
+        return false;
+    }
+    if (payload) {
+        *payload = found->second;
+    }
+    return true;
+}
+
+size_t LoopbackBroker::clientCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = 0;
+    for (auto &session : sessions) {
+        if (session->connected && !session->finished) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool LoopbackBroker::waitForMessage(const std::string &topic, const char *payload, unsigned long timeoutMs) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return historyChanged.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]() {
+        for (auto &message : history) {
+            if (message.topic == topic && (!payload || message.payload == payload)) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+void LoopbackBroker::clearHistory() {
+    std::lock_guard<std::mutex> lock(mutex);
+    history.clear();
+}
+
+// MQTT filter matching: '+' matches exactly one level, '#' matches the parent level and everything below
+bool LoopbackBroker::topicMatches(const std::string &filter, const std::string &topic) {
+    size_t f = 0;
+    size_t t = 0;
+    while (true) {
+        size_t filterEnd = filter.find('/', f);
+        size_t topicEnd = topic.find('/', t);
+        std::string level = filter.substr(f, filterEnd == std::string::npos ? std::string::npos : filterEnd - f);
+        if (level == "#") {
+            return true;
+        }
+        if (t == std::string::npos) {
+            return false; // Topic ran out of levels before the filter did
+        }
+        if (level != "+" && topic.compare(t, topicEnd == std::string::npos ? std::string::npos : topicEnd - t,
+                                          level) != 0) {
+            return false;
+        }
+        if (filterEnd == std::string::npos) {
+            return topicEnd == std::string::npos;
+        }
+        f = filterEnd + 1;
+        t = topicEnd == std::string::npos ? std::string::npos : topicEnd + 1;
+    }
+}
+
+void LoopbackBroker::acceptLoop() {
+    while (running) {
+        pollfd descriptor;
+        descriptor.fd = listenSock;
+        descriptor.events = POLLIN;
+        descriptor.revents = 0;
+        if (poll(&descriptor, 1, 50) <= 0) {
+            reapFinished();
+            continue;
+        }
+        int fd = accept(listenSock, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        std::shared_ptr<Session> session(new Session());
+        session->sock = fd;
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions.push_back(session);
+        session->thread = std::thread(&LoopbackBroker::serve, this, session);
+    }
+}
+
+// Join the threads of connections that have ended
+void LoopbackBroker::reapFinished() {
+    std::vector<std::shared_ptr<Session> > finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < sessions.size();) {
+            if (sessions[i]->finished) {
+                finished.push_back(sessions[i]);
+                sessions[i] = sessions.back();
+                sessions.pop_back();
+            } else {
+                i++;
+            }
+        }
+    }
+    for (auto &session : finished) {
+        session->thread.join();
+    }
+}
+
+void LoopbackBroker::serve(std::shared_ptr<Session> session) {
+    std::string buffer;
+    std::string body;
+    char chunk[4096];
+    bool open = true;
+    while (open) {
+        ssize_t received = recv(session->sock, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            break;
+        }
+        buffer.append(chunk, received);
+
+        uint8_t header;
+        bool malformed;
+        while (open && MqttWire::nextPacket(buffer, header, body, malformed)) {
+            open = handlePacket(session, header, body);
+        }
+        if (malformed) {
+            break;
+        }
+    }
+
+    bool publishWill = session->connected && !session->cleanDisconnect && session->hasWill;
+    {
+        std::lock_guard<std::mutex> lock(session->writeMutex);
+        close(session->sock);
+        session->sock = -1;
+    }
+    if (publishWill && running) {
+        route(session->will);
+    }
+    session->finished = true;
+}
+
+// Handle one packet from a client; returns false to close the connection
+bool LoopbackBroker::handlePacket(const std::shared_ptr<Session> &session, uint8_t header, const std::string &body) {
+    MqttWire::Reader reader(body);
+    uint8_t type = header >> 4;
+
+    if (!session->connected && type != MqttWire::CONNECT) {
+        return false; // First packet must be CONNECT
+    }
+
+    switch (type) {
+    case MqttWire::CONNECT: {
+        if (session->connected) {
+            return false; // A second CONNECT is a protocol violation
+        }
+        std::string protocol = reader.str();
+        uint8_t level = reader.u8();
+        uint8_t flags = reader.u8();
+        reader.u16(); // Keep-alive: the loopback broker never times clients out
+        session->clientId = reader.str();
+        if (flags & 0x04) {
+            session->hasWill = true;
+            session->will.clientId = session->clientId;
+            session->will.topic = reader.str();
+            session->will.payload = reader.str();
+            session->will.qos = (flags >> 3) & 0x03;
+            session->will.retain = flags & 0x20;
+            session->will.will = true;
+        }
+        if (flags & 0x80) {
+            reader.str(); // Username: accepted but not checked
+        }
+        if (flags & 0x40) {
+            reader.str(); // Password
+        }
+        if (!reader.ok || protocol != "MQTT" || level != 4) {
+            send(session, MqttWire::frame(MqttWire::CONNACK << 4, std::string("\x00\x01", 2)));
+            return false;
+        }
+        if (!acceptConnections) {
+            send(session, MqttWire::frame(MqttWire::CONNACK << 4, std::string("\x00\x03", 2)));
+            return false;
+        }
+
+        // Take over any live connection with the same client identifier
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto &other : sessions) {
+                if (other != session && other->connected && !other->finished &&
+                    other->clientId == session->clientId) {
+                    other->cleanDisconnect = true;
+                    cut(other);
+                }
+            }
+        }
+        session->connected = true;
+        connects++;
+        return send(session, MqttWire::frame(MqttWire::CONNACK << 4, std::string("\x00\x00", 2)));
+    }
+    case MqttWire::PUBLISH: {
+        Message message;
+        message.clientId = session->clientId;
+        message.qos = (header >> 1) & 0x03;
+        message.retain = header & 0x01;
+        message.will = false;
+        message.topic = reader.str();
+        uint16_t packetId = message.qos ? reader.u16() : 0;
+        message.payload = reader.rest();
+        if (!reader.ok || message.qos == 3) {
+            return false;
+        }
+        publishes++;
+        bytes += message.payload.size();
+        route(message);
+        if (message.qos == 1) {
+            return send(session, MqttWire::ack(MqttWire::PUBACK << 4, packetId));
+        }
+        if (message.qos == 2) {
+            return send(session, MqttWire::ack(MqttWire::PUBREC << 4, packetId));
+        }
+        return true;
+    }
+    case MqttWire::PUBREL:
+        return send(session, MqttWire::ack(MqttWire::PUBCOMP << 4, reader.u16()));
+    case MqttWire::PUBREC:
+        return send(session, MqttWire::ack((MqttWire::PUBREL << 4) | 0x02, reader.u16()));
+    case MqttWire::PUBACK:
+    case MqttWire::PUBCOMP:
+        return true; // Outgoing deliveries are fire-and-forget
+    case MqttWire::SUBSCRIBE: {
+        uint16_t packetId = reader.u16();
+        std::string granted;
+        std::vector<std::string> filters;
+        while (reader.ok && reader.pos < body.size()) {
+            std::string filter = reader.str();
+            uint8_t qos = reader.u8() & 0x03;
+            if (!reader.ok) {
+                return false;
+            }
+            filters.push_back(filter);
+            granted.push_back((char)qos);
+            std::lock_guard<std::mutex> lock(mutex);
+            bool replaced = false;
+            for (auto &subscription : session->subscriptions) {
+                if (subscription.first == filter) {
+                    subscription.second = qos;
+                    replaced = true;
+                }
+            }
+            if (!replaced) {
+                session->subscriptions.push_back(std::make_pair(filter, qos));
+            }
+        }
+        std::string ackBody;
+        MqttWire::appendU16(ackBody, packetId);
+        ackBody += granted;
+        if (!send(session, MqttWire::frame(MqttWire::SUBACK << 4, ackBody))) {
+            return false;
+        }
+
+        // Replay retained messages that match the new filters
+        std::vector<Message> replay;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto &retainedMessage : retainedMessages) {
+                for (size_t i = 0; i < filters.size(); i++) {
+                    if (topicMatches(filters[i], retainedMessage.first)) {
+                        Message message;
+                        message.topic = retainedMessage.first;
+                        message.payload = retainedMessage.second;
+                        message.qos = (uint8_t)granted[i];
+                        message.retain = true;
+                        message.will = false;
+                        replay.push_back(message);
+                        break;
+                    }
+                }
+            }
+        }
+        for (auto &message : replay) {
+            deliver(session, message, message.qos, true);
+        }
+        return true;
+    }
+    case MqttWire::UNSUBSCRIBE: {
+        uint16_t packetId = reader.u16();
+        while (reader.ok && reader.pos < body.size()) {
+            std::string filter = reader.str();
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < session->subscriptions.size(); i++) {
+                if (session->subscriptions[i].first == filter) {
+                    session->subscriptions.erase(session->subscriptions.begin() + i);
+                    break;
+                }
+            }
+        }
+        return send(session, MqttWire::ack(MqttWire::UNSUBACK << 4, packetId));
+    }
+    case MqttWire::PINGREQ:
+        return send(session, std::string(1, (char)(MqttWire::PINGRESP << 4)) + '\0');
+    case MqttWire::DISCONNECT:
+        session->cleanDisconnect = true;
+        return false;
+    default:
+        return false;
+    }
+}
+
+// Store, record and fan out a message to every matching subscription
+void LoopbackBroker::route(const Message &message) {
+    std::vector<std::pair<std::shared_ptr<Session>, uint8_t> > targets;
+    std::vector<PublishObserver> notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (message.retain) {
+            if (message.payload.empty()) {
+                retainedMessages.erase(message.topic);
+            } else {
+                retainedMessages[message.topic] = message.payload;
+            }
+        }
+        for (auto &session : sessions) {
+            if (!session->connected || session->finished) {
+                continue;
+            }
+            int best = -1;
+            for (auto &subscription : session->subscriptions) {
+                if (topicMatches(subscription.first, message.topic) && subscription.second > best) {
+                    best = subscription.second;
+                }
+            }
+            if (best >= 0) {
+                targets.push_back(std::make_pair(session, (uint8_t)(best < message.qos ? best : message.qos)));
+            }
+        }
+        notify = observers;
+    }
+
+    // Observers run before the message becomes visible to waitForMessage()
+    for (auto &observer : notify) {
+        observer(message);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        history.push_back(message);
+        if (history.size() > historyLimit) {
+            history.pop_front();
+        }
+    }
+    historyChanged.notify_all();
+    for (auto &target : targets) {
+        deliver(target.first, message, target.second, false);
+    }
+}
+
+void LoopbackBroker::deliver(const std::shared_ptr<Session> &session, const Message &message, uint8_t qos,
+                             bool retain) {
+    uint16_t packetId = 0;
+    if (qos > 0) {
+        std::lock_guard<std::mutex> lock(session->writeMutex);
+        packetId = session->nextPacketId++;
+        if (packetId == 0) {
+            packetId = session->nextPacketId++;
+        }
+    }
+    send(session, MqttWire::publish(message.topic.data(), message.topic.size(), qos, retain, false, packetId,
+                                    message.payload.data(), message.payload.size()));
+}
+
+bool LoopbackBroker::send(const std::shared_ptr<Session> &session, const std::string &packet) {
+    std::lock_guard<std::mutex> lock(session->writeMutex);
+    if (session->sock < 0) {
+        return false;
+    }
+    size_t sent = 0;
+    while (sent < packet.size()) {
+        ssize_t written = ::send(session->sock, packet.data() + sent, packet.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0) {
+            return false;
+        }
+        sent += written;
+    }
+    return true;
+}
+
+// Close a connection from the broker side; the session thread sees EOF and cleans up
+void LoopbackBroker::cut(const std::shared_ptr<Session> &session) {
+    std::lock_guard<std::mutex> lock(session->writeMutex);
+    if (session->sock >= 0) {
+        shutdown(session->sock, SHUT_RDWR);
+    }
+}
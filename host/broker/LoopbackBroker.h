@@ -0,0 +1,116 @@
+#ifndef LOOPBACKBROKER_H
+#define LOOPBACKBROKER_H
+
+/*
+ * In-process MQTT 3.1.1 broker bound to 127.0.0.1, for host tests and
+ * benchmarks that need a real TCP peer without an external mosquitto.
+ *
+ * Supports CONNECT (including the will), PUBLISH at QoS 0/1/2, SUBSCRIBE and
+ * UNSUBSCRIBE with + and # wildcards, retained messages, PINGREQ and
+ * DISCONNECT. A connection that ends without DISCONNECT - including one cut
+ * by dropClient() - gets its will published, as a real broker would.
+ *
+ * There is no session persistence: every connection starts clean and
+ * outgoing QoS 1/2 deliveries are fire-and-forget.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class LoopbackBroker {
+public:
+    struct Message {
+        std::string clientId; // Publisher (for wills: the client that went away)
+        std::string topic;
+        std::string payload;
+        uint8_t qos;
+        bool retain;
+        bool will; // Published on behalf of a client that disconnected abruptly
+    };
+
+    typedef std::function<void(const Message &message)> PublishObserver;
+
+    LoopbackBroker();
+    ~LoopbackBroker();
+
+    uint16_t start(uint16_t port = 0); // Listen on 127.0.0.1 (0 picks a free port); returns the port or 0
+    void stop(); // Close every connection and the listening socket
+    uint16_t port() const { return listenPort; }
+
+    // Called on a broker thread for every message the broker accepts, wills included
+    void onPublish(PublishObserver observer);
+
+    // Refuse new connections with CONNACK "server unavailable" to simulate an outage
+    void setAcceptConnections(bool accept);
+
+    bool dropClient(const std::string &clientId); // Cut one connection without DISCONNECT
+    size_t dropAllClients();                      // Cut every connection; returns how many
+
+    bool retained(const std::string &topic, std::string *payload = nullptr) const;
+    size_t clientCount() const;
+    unsigned long publishCount() const { return publishes.load(); }     // PUBLISH packets received
+    unsigned long long payloadBytes() const { return bytes.load(); }     // Payload bytes received
+    unsigned long connectCount() const { return connects.load(); }       // CONNECT packets accepted
+
+    // Block until a message matching topic (and payload, when given) is in the history
+    bool waitForMessage(const std::string &topic, const char *payload, unsigned long timeoutMs);
+    void clearHistory(); // Forget earlier messages so waitForMessage() only sees new ones
+
+    static bool topicMatches(const std::string &filter, const std::string &topic);
+
+private:
+    struct Session {
+        int sock;
+        std::string clientId;
+        std::atomic<bool> connected;       // CONNECT accepted
+        std::atomic<bool> cleanDisconnect; // DISCONNECT received (or taken over): discard the will
+        bool hasWill;
+        Message will;
+        std::vector<std::pair<std::string, uint8_t> > subscriptions;
+        uint16_t nextPacketId;
+        std::atomic<bool> finished;
+        std::mutex writeMutex;
+        std::thread thread;
+
+        Session() : sock(-1), connected(false), cleanDisconnect(false), hasWill(false), nextPacketId(1),
+                    finished(false) {}
+    };
+
+    int listenSock;
+    uint16_t listenPort;
+    std::atomic<bool> running;
+    std::atomic<bool> acceptConnections;
+    std::thread acceptThread;
+
+    mutable std::mutex mutex; // Guards sessions, retainedMessages, observers and history
+    std::vector<std::shared_ptr<Session> > sessions;
+    std::map<std::string, std::string> retainedMessages;
+    std::vector<PublishObserver> observers;
+    std::deque<Message> history; // Most recent messages, for waitForMessage()
+    std::condition_variable historyChanged;
+
+    std::atomic<unsigned long> publishes;
+    std::atomic<unsigned long long> bytes;
+    std::atomic<unsigned long> connects;
+
+    void acceptLoop();
+    void serve(std::shared_ptr<Session> session);
+    bool handlePacket(const std::shared_ptr<Session> &session, uint8_t header, const std::string &body);
+    void route(const Message &message);
+    void deliver(const std::shared_ptr<Session> &session, const Message &message, uint8_t qos, bool retain);
+    static bool send(const std::shared_ptr<Session> &session, const std::string &packet);
+    static void cut(const std::shared_ptr<Session> &session);
+    void reapFinished();
+};
+
+#endif // LOOPBACKBROKER_H
@@ -0,0 +1,36 @@
+/*
+ * Host counterpart of examples/example.cpp: connects to a broker and publishes
+ * a test message every second.
+ *
+ *     ./mqttmanager_host_example [server] [port] [seconds]
+ */
+
+#include <Arduino.h>
+#include <MqttManager.h>
+
+MqttManager mqttManager;
+
+int main(int argc, char **argv) {
+    const char *server = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 1883;
+    unsigned long runTime = (argc > 3 ? strtoul(argv[3], nullptr, 10) : 10) * 1000UL;
+
+    Serial.begin(115200);
+    mqttManager.setServer(server, port);
+    mqttManager.setLwt("korngva/sound_monitor/device_status");
+    mqttManager.connect();
+
+    unsigned long lastMessageTime = 0;
+    while (millis() < runTime) {
+        mqttManager.reconnect();
+        if (millis() - lastMessageTime >= 1000) {
+            mqttManager.sendMessage("korngva/sound_monitor/test_topic", "Hello from the host build!");
+            lastMessageTime = millis();
+        }
+        delay(10);
+    }
+
+    Serial.print("Messages still queued: ");
+    Serial.println((unsigned long)mqttManager.outboxSize());
+    return 0;
+}
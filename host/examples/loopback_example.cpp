@@ -0,0 +1,596 @@
+/*
+ * Runs MqttManager against the in-process loopback broker and checks the
+ * connection-status contract end to end:
+ *
+ *   1. online_message is published (retained) on the LWT topic after connect,
+ *      with the broker given by host name
+ *   2. an abrupt connection loss makes the broker publish offline_message
+ *   3. messages sent while offline are delivered after the reconnect, which
+ *      reuses the cached broker address instead of resolving it again; of a
+ *      latest-only state topic, only the newest value is kept and delivered,
+ *      ahead of the rest when it was sent URGENT; a reconnect does not wait
+ *      for a pending DNS lookup but uses the cached address
+ *   4. binary payloads arrive byte for byte, embedded NULs included
+ *   5. a QoS 1 publish is acknowledged, leaves the in-flight table and runs its
+ *      completion callback
+ *   6. a wildcard subscription receives matching messages
+ *   7. with a backup broker configured, the client fails over when the primary
+ *      refuses connections and fails back once it accepts them again, and its
+ *      subscriptions are renewed on every new connection
+ *   8. in deferred mode, connection events and messages are only handled by
+ *      poll(), on the thread that calls it
+ *   9. messages queued from several threads with queueMessage() are all
+ *      published by poll()
+ *  10. with a publisher task, sendMessage() from the main thread is published
+ *      by that task and the connection is kept up without poll()/reconnect()
+ *  11. a BasicMqttManager with its own, smaller limits connects and publishes
+ *  12. payloads built in leased pool buffers are published, and the buffers
+ *      go back to the pool, so leasing never runs dry in a steady loop
+ *  13. heap buffers handed over with std::unique_ptr are published; a queued
+ *      one is held by the queue itself, so it may exceed the queue's slot size
+ *  14. topics registered from a {device}/{sensor} pattern are published and
+ *      queued by handle, with options set for the topic after registering it
+ *  15. QoS 0 messages collected with beginBatch()/endBatch() or a batch window
+ *      reach the broker in order from a single write, and a QoS 1 message
+ *      does not overtake batched ones
+ *  16. a topic over its rate limit has messages dropped or coalesced, a
+ *      global limit queues messages and releases them in order as it refills,
+ *      and a topic waiting for its own tokens does not hold up other topics
+ *  17. queued URGENT messages go ahead of a BULK backlog, strictly or taking
+ *      turns with it in proportion to the lane weights
+ *
+ * Exits with a non-zero status if any step does not happen.
+ */
+
+#include <Arduino.h>
+#include <MqttManager.h>
+#include <WiFi.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "LoopbackBroker.h"
+
+namespace {
+
+const char *statusTopic = "korngva/sound_monitor/device_status";
+const char *dataTopic = "korngva/sound_monitor/first_floor/sound_state";
+const char *stateTopic = "korngva/sound_monitor/first_floor/recorder_state";
+
+int failures = 0;
+
+void check(bool condition, const char *what) {
+    Serial.print(condition ? "PASS " : "FAIL ");
+    Serial.println(what);
+    if (!condition) {
+        failures++;
+    }
+}
+
+// Keep calling poll() and reconnect() until the condition holds or the timeout expires
+template <typename Condition>
+bool runUntil(MqttManager &manager, Condition condition, unsigned long timeoutMs) {
+    unsigned long started = millis();
+    while (!condition()) {
+        if (millis() - started >= timeoutMs) {
+            return false;
+        }
+        manager.poll();
+        manager.reconnect();
+        delay(5);
+    }
+    return true;
+}
+
+// Counts messages seen by a subscription handler (runs on the client's network thread)
+struct Received {
+    std::mutex mutex;
+    int count = 0;
+    std::string lastTopic;
+    std::string lastPayload;
+    std::thread::id lastThread;
+};
+
+void onCommand(const MqttInboundMessage &message, void *context) {
+    Received *received = (Received *)context;
+    std::lock_guard<std::mutex> lock(received->mutex);
+    received->count++;
+    received->lastTopic = message.topic;
+    received->lastPayload.assign((const char *)message.payload, message.length);
+    received->lastThread = std::this_thread::get_id();
+}
+
+// A cut-down configuration whose RAM footprint is checked at compile time
+struct SmallLimits : MqttManagerLimits {
+    static const size_t inflightSize = 2;
+    static const size_t maxServers = 1;
+    static const size_t maxSubscriptions = 4;
+    static const size_t maxTopicNodes = 8;
+    static const size_t reassemblyBuffers = 1;
+    static const size_t maxInboundLen = 512;
+    static const size_t eventQueueSize = 8;
+    static const size_t publishQueueSize = 4;
+    static const size_t maxTopicOptions = 2;
+    static const size_t maxTopics = 4;
+    static const size_t batchBytes = 256;
+    static const size_t batchMessages = 4;
+    static const size_t maxRateLimits = 2;
+    static const size_t maxLatestOnly = 2;
+    static const size_t ramBudget = 8192;
+};
+typedef BasicMqttManager<48, 128, 4, SmallLimits> SmallMqttManager;
+
+// A lookup that only finishes when told to, to show that connecting never waits for DNS
+struct HeldResolver : MqttResolver {
+    std::atomic<MqttLookupStatus> state{MqttLookupStatus::FAILED};
+    int lookups = 0;
+
+    bool begin(const char *host) override {
+        (void)host;
+        lookups++;
+        state = MqttLookupStatus::PENDING;
+        return true;
+    }
+
+    MqttLookupStatus status(IPAddress &address) override {
+        if (state == MqttLookupStatus::RESOLVED) {
+            address = IPAddress(127, 0, 0, 1);
+        }
+        return state;
+    }
+};
+
+int receivedCount(Received &received) {
+    std::lock_guard<std::mutex> lock(received.mutex);
+    return received.count;
+}
+
+} // namespace
+
+int main() {
+    LoopbackBroker broker;
+    uint16_t port = broker.start();
+    if (port == 0) {
+        Serial.println("Could not start the loopback broker");
+        return 1;
+    }
+
+    MqttManager mqttManager;
+    mqttManager.setServer("localhost", port);
+    mqttManager.setLwt(statusTopic);
+    mqttManager.connect();
+
+    check(runUntil(mqttManager, [&]() { return broker.waitForMessage(statusTopic, "on", 0); }, 5000),
+          "online message published after connect");
+    std::string status;
+    check(broker.retained(statusTopic, &status) && status == "on", "online message is retained");
+
+    broker.clearHistory();
+    broker.setAcceptConnections(false); // Keep the client offline until we are done queueing
+    broker.dropAllClients();
+    check(broker.waitForMessage(statusTopic, "off", 5000), "offline message published as the will");
+    check(runUntil(mqttManager, [&]() { return !mqttManager.isConnected(); }, 5000), "client noticed the drop");
+
+    mqttManager.setLatestOnly(stateTopic);
+    std::vector<std::string> states;
+    std::vector<std::string> drained; // Payloads of both topics, in arrival order
+    std::mutex statesMutex;
+    broker.onPublish([&](const LoopbackBroker::Message &message) {
+        std::lock_guard<std::mutex> lock(statesMutex);
+        if (message.topic == stateTopic) {
+            states.push_back(message.payload);
+        }
+        if (message.topic == stateTopic || message.topic == dataTopic) {
+            drained.push_back(message.payload);
+        }
+    });
+    mqttManager.sendMessage(stateTopic, "idle");
+    mqttManager.sendMessage(dataTopic, "queued-1");
+    mqttManager.sendMessage(stateTopic, "recording");
+    mqttManager.sendMessage(dataTopic, "queued-2");
+    mqttManager.sendMessage(stateTopic, "uploading");
+    mqttManager.sendMessage(stateTopic, "fault", MqttPublishOptions(0, true, nullptr, nullptr, MqttPriority::URGENT));
+    check(mqttManager.outboxSize() == 3 && mqttManager.outboxReplaced() == 3,
+          "messages queued while offline, one per latest-only topic");
+
+    broker.setAcceptConnections(true);
+    check(runUntil(mqttManager, [&]() { return mqttManager.isConnected(); }, 40000), "client reconnected");
+    check(runUntil(mqttManager, [&]() { return broker.waitForMessage(statusTopic, "on", 0); }, 5000),
+          "online message published after reconnect");
+    check(broker.waitForMessage(dataTopic, "queued-2", 5000), "queued messages delivered after reconnect");
+    check(mqttManager.outboxSize() == 0, "outbox drained");
+    {
+        std::lock_guard<std::mutex> lock(statesMutex);
+        check(states.size() == 1 && states[0] == "fault", "only the newest state delivered");
+        check(!drained.empty() && drained[0] == "fault", "newest state moved to its URGENT lane");
+    }
+    check(WiFi.lookupCount() == 1, "broker host name resolved once");
+
+    HeldResolver dns;
+    mqttManager.setResolver(&dns);
+    mqttManager.setDnsCacheTtl(0, 0); // The cached address is due for a lookup at once
+    broker.dropAllClients();
+    check(runUntil(mqttManager, [&]() { return !mqttManager.isConnected(); }, 5000) &&
+              runUntil(mqttManager, [&]() { return mqttManager.isConnected(); }, 40000),
+          "reconnected to the cached address while its lookup is pending");
+    check(dns.lookups == 1 && dns.state == MqttLookupStatus::PENDING, "one lookup started, nothing waited for it");
+    mqttManager.setDnsCacheTtl(300000, 3600000);
+    dns.state = MqttLookupStatus::RESOLVED;
+    mqttManager.poll();
+    mqttManager.setResolver(nullptr);
+
+    const uint8_t frame[] = {0x01, 0x00, 0xFF, 0x00, 0x7F};
+    std::string expected((const char *)frame, sizeof(frame));
+    std::string received;
+    std::mutex receivedMutex;
+    broker.onPublish([&](const LoopbackBroker::Message &message) {
+        if (message.topic == "korngva/sound_monitor/first_floor/raw_frame") {
+            std::lock_guard<std::mutex> lock(receivedMutex);
+            received = message.payload;
+        }
+    });
+    mqttManager.sendMessage("korngva/sound_monitor/first_floor/raw_frame", frame, sizeof(frame));
+    check(broker.waitForMessage("korngva/sound_monitor/first_floor/raw_frame", nullptr, 5000),
+          "binary payload published");
+    {
+        std::lock_guard<std::mutex> lock(receivedMutex);
+        check(received == expected, "binary payload arrived unchanged");
+    }
+
+    volatile bool acknowledged = false;
+    MqttPublishHandle handle = mqttManager.sendMessage(
+        "korngva/sound_monitor/first_floor/sound_level", "42",
+        MqttPublishOptions(1, false, [](const MqttPublishHandle &handle, void *context) {
+            *(volatile bool *)context = handle.status == MqttDeliveryStatus::ACKNOWLEDGED;
+        }, (void *)&acknowledged));
+    check(handle.status == MqttDeliveryStatus::IN_FLIGHT && handle.packetId != 0, "QoS 1 message in flight");
+    check(broker.waitForMessage("korngva/sound_monitor/first_floor/sound_level", "42", 5000), "QoS 1 message published");
+    check(runUntil(mqttManager, [&]() { return acknowledged; }, 5000),
+          "completion callback reported the acknowledgement");
+    check(mqttManager.acknowledgedCount() == 1, "QoS 1 message acknowledged");
+    check(mqttManager.inflightCount() == 0, "in-flight table empty after the acknowledgement");
+    check(!broker.retained("korngva/sound_monitor/first_floor/sound_level", nullptr), "retain=false is honored");
+
+    Received commands;
+    check(mqttManager.subscribe("korngva/+/commands/#", 1, onCommand, &commands), "wildcard subscription added");
+    delay(100); // Let the SUBSCRIBE reach the broker before publishing
+    mqttManager.sendMessage("korngva/sound_monitor/commands/reset", "1", MqttPublishOptions(0, false));
+    mqttManager.sendMessage("korngva/sound_monitor/status", "ignored", MqttPublishOptions(0, false));
+    check(runUntil(mqttManager, [&]() { return receivedCount(commands) == 1; }, 5000),
+          "handler received the matching message");
+    {
+        std::lock_guard<std::mutex> lock(commands.mutex);
+        check(commands.lastTopic == "korngva/sound_monitor/commands/reset", "handler saw the full topic");
+    }
+
+    std::string firmware(2000, '\0'); // More than one TCP segment: the client delivers it in chunks
+    for (size_t i = 0; i < firmware.size(); i++) {
+        firmware[i] = (char)(i * 7);
+    }
+    mqttManager.sendMessage("korngva/sound_monitor/commands/firmware", (const uint8_t *)firmware.data(),
+                            firmware.size(), MqttPublishOptions(0, false));
+    check(runUntil(mqttManager, [&]() { return receivedCount(commands) == 2; }, 5000),
+          "handler received the chunked message");
+    {
+        std::lock_guard<std::mutex> lock(commands.mutex);
+        check(commands.lastPayload == firmware, "chunked payload reassembled in one piece");
+    }
+    mqttManager.setMaxInboundLength(1000);
+    mqttManager.sendMessage("korngva/sound_monitor/commands/firmware", (const uint8_t *)firmware.data(),
+                            firmware.size(), MqttPublishOptions(0, false));
+    check(runUntil(mqttManager, [&]() { return mqttManager.inboundDropped() == 1; }, 5000),
+          "payload over the inbound limit dropped");
+    check(receivedCount(commands) == 2, "oversized payload not delivered");
+
+    LoopbackBroker backup;
+    uint16_t backupPort = backup.start();
+    check(mqttManager.addServer("127.0.0.1", backupPort, 1), "backup broker added");
+    mqttManager.setFailbackInterval(500);
+    broker.setAcceptConnections(false);
+    broker.dropAllClients();
+    check(runUntil(mqttManager, [&]() { return mqttManager.isConnected() && backup.clientCount() == 1; }, 20000),
+          "failed over to the backup broker");
+    broker.setAcceptConnections(true);
+    check(runUntil(mqttManager, [&]() { return mqttManager.isConnected() && broker.clientCount() == 1; }, 20000),
+          "failed back to the primary broker");
+    delay(100);
+    mqttManager.sendMessage("korngva/sound_monitor/commands/reboot", "1", MqttPublishOptions(0, false));
+    check(runUntil(mqttManager, [&]() { return receivedCount(commands) == 3; }, 5000),
+          "subscription renewed after reconnecting");
+
+    MqttManager deferred;
+    Received deferredCommands;
+    deferred.setDeferredDispatch(true);
+    deferred.setServer("127.0.0.1", port);
+    deferred.setLwt("korngva/deferred/device_status");
+    deferred.subscribe("korngva/deferred/commands", 0, onCommand, &deferredCommands);
+    deferred.connect();
+    check(!broker.waitForMessage("korngva/deferred/device_status", "on", 500),
+          "deferred mode: onConnect waits for poll()");
+    auto onlineSeen = [&]() { return broker.retained("korngva/deferred/device_status", &status) && status == "on"; };
+    check(runUntil(deferred, onlineSeen, 5000),
+          "deferred mode: poll() runs onConnect");
+    delay(100); // Let the SUBSCRIBE reach the broker before publishing
+    mqttManager.sendMessage("korngva/deferred/commands", "1", MqttPublishOptions(0, false));
+    delay(300);
+    check(receivedCount(deferredCommands) == 0, "deferred mode: message waits for poll()");
+    check(runUntil(deferred, [&]() { return receivedCount(deferredCommands) == 1; }, 5000),
+          "deferred mode: poll() dispatches the message");
+    {
+        std::lock_guard<std::mutex> lock(deferredCommands.mutex);
+        check(deferredCommands.lastThread == std::this_thread::get_id(), "deferred mode: handler ran on the polling thread");
+    }
+    check(deferred.eventsDropped() == 0, "deferred mode: no events dropped");
+
+    unsigned long publishedBefore = broker.publishCount();
+    std::atomic<int> producersDone(0);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 4; p++) {
+        producers.emplace_back([&]() {
+            for (int i = 0; i < 50; i++) {
+                while (!mqttManager.queueMessage("korngva/sound_monitor/queued", "1", MqttPublishOptions(0, false)).ok()) {
+                    std::this_thread::yield(); // Queue full until poll() catches up
+                }
+            }
+            producersDone++;
+        });
+    }
+    check(runUntil(mqttManager, [&]() { return producersDone == 4 && broker.publishCount() - publishedBefore == 200; },
+                   5000),
+          "messages queued from four threads all published");
+    for (std::thread &producer : producers) {
+        producer.join();
+    }
+
+    MqttManager tasked;
+    tasked.setServer("127.0.0.1", port);
+    tasked.setLwt("korngva/tasked/device_status");
+    tasked.connect();
+    check(tasked.startPublisherTask(0, 1), "publisher task started");
+    auto taskedOnline = [&]() { return broker.retained("korngva/tasked/device_status", &status) && status == "on"; };
+    unsigned long waitStarted = millis();
+    while (!taskedOnline() && millis() - waitStarted < 5000) {
+        delay(5); // No poll() or reconnect(): the task does the work
+    }
+    check(taskedOnline(), "publisher task: onConnect ran without poll()");
+    publishedBefore = broker.publishCount();
+    for (int i = 0; i < 100; i++) {
+        while (!tasked.sendMessage("korngva/tasked/data", "1", MqttPublishOptions(0, false)).ok()) {
+            delay(1); // Queue full until the task catches up
+        }
+    }
+    bool accepted = false;
+    waitStarted = millis();
+    while (!accepted && millis() - waitStarted < 5000) {
+        accepted = tasked.queueMessage("korngva/tasked/data", "2", MqttPublishOptions(0, false)).ok();
+        delay(accepted ? 0 : 1); // The queue may still be full from the loop above
+    }
+    check(accepted, "publisher task: queueMessage() accepted");
+    check(tasked.poll() == 0, "publisher task: poll() from another thread is a no-op");
+    waitStarted = millis();
+    while (broker.publishCount() - publishedBefore < 101 && millis() - waitStarted < 5000) {
+        delay(5);
+    }
+    check(broker.publishCount() - publishedBefore == 101, "publisher task: queued and sent messages all published");
+    tasked.setRateLimit(1, 1, MqttRateLimitPolicy::DROP);
+    check(!tasked.setTopicRateLimit("korngva/tasked/data", 1, 1, MqttRateLimitPolicy::DROP),
+          "publisher task: rate limit changes from another thread refused");
+    publishedBefore = broker.publishCount();
+    for (int i = 0; i < 5; i++) {
+        while (!tasked.sendMessage("korngva/tasked/data", "3", MqttPublishOptions(0, false)).ok()) {
+            delay(1);
+        }
+    }
+    waitStarted = millis();
+    while (broker.publishCount() - publishedBefore < 5 && millis() - waitStarted < 5000) {
+        delay(5);
+    }
+    check(broker.publishCount() - publishedBefore == 5, "publisher task: refused rate limit left publishing unthrottled");
+    tasked.stopPublisherTask();
+    check(tasked.setTopicRateLimit("korngva/tasked/data", 1, 1, MqttRateLimitPolicy::DROP),
+          "publisher task stopped: rate limit accepted again");
+
+    SmallMqttManager small;
+    small.setServer("127.0.0.1", port);
+    small.setLwt("korngva/small/device_status");
+    small.connect();
+    auto smallOnline = [&]() { return broker.retained("korngva/small/device_status", &status) && status == "on"; };
+    waitStarted = millis();
+    while (!smallOnline() && millis() - waitStarted < 5000) {
+        small.reconnect();
+        delay(5);
+    }
+    check(smallOnline(), "small configuration connected");
+    small.sendMessage("korngva/small/data", "1", MqttPublishOptions(0, false));
+    check(broker.waitForMessage("korngva/small/data", "1", 5000), "small configuration published");
+    Serial.printf("sizeof(MqttManager) = %u bytes, sizeof(SmallMqttManager) = %u bytes\n",
+                  (unsigned)sizeof(MqttManager), (unsigned)sizeof(SmallMqttManager));
+
+    // More rounds than the pool has buffers: each send must return its block
+    for (int i = 0; i < 40; i++) {
+        MqttPayloadLease payload = mqttManager.leasePayload(16);
+        payload.appendf("{\"level\":%d}", i);
+        mqttManager.sendMessage("korngva/sound_monitor/first_floor/leased", std::move(payload), MqttPublishOptions(0, false));
+    }
+    check(broker.waitForMessage("korngva/sound_monitor/first_floor/leased", "{\"level\":39}", 5000),
+          "leased payload published");
+    check(mqttManager.payloadPoolExhausted() == 0, "leased buffers returned to the pool");
+    MqttPayloadLease held[MQTTMANAGER_PAYLOAD_LARGE_BLOCKS];
+    for (MqttPayloadLease &lease : held) {
+        lease = mqttManager.leasePayload(MQTTMANAGER_MAX_PAYLOAD_LEN);
+    }
+    MqttPayloadLease none = mqttManager.leasePayload(MQTTMANAGER_MAX_PAYLOAD_LEN);
+    check(held[0] && !none && mqttManager.payloadPoolExhausted() == 1, "empty lease once the large buffers are out");
+    check(!mqttManager.queueMessage("korngva/sound_monitor/first_floor/leased", std::move(none)).ok(),
+          "empty lease is not published");
+
+    std::unique_ptr<uint8_t[]> spectrum(new uint8_t[600]);
+    memset(spectrum.get(), 's', 600);
+    std::thread([&]() {
+        mqttManager.queueMessage("korngva/sound_monitor/first_floor/spectrum", std::move(spectrum), 600,
+                                 MqttPublishOptions(0, false));
+    }).join();
+    check(!spectrum, "owned buffer moved into the queue");
+    check(runUntil(mqttManager, [&]() {
+        return broker.waitForMessage("korngva/sound_monitor/first_floor/spectrum", std::string(600, 's').c_str(), 0);
+    }, 5000), "owned payload larger than a queue slot published by poll()");
+    std::unique_ptr<uint8_t[]> reading(new uint8_t[2]{'o', 'k'});
+    mqttManager.sendMessage("korngva/sound_monitor/first_floor/owned", std::move(reading), 2, MqttPublishOptions(0, false));
+    check(broker.waitForMessage("korngva/sound_monitor/first_floor/owned", "ok", 5000), "owned payload sent directly");
+
+    mqttManager.setTopicVariable("device", "sound_monitor");
+    mqttManager.setTopicVariable("sensor", "sound_state");
+    MqttTopic soundState = mqttManager.registerTopic("korngva/{device}/second_floor/{sensor}");
+    check(soundState.valid() && strcmp(mqttManager.topicName(soundState), "korngva/sound_monitor/second_floor/sound_state") == 0,
+          "topic pattern expanded at registration");
+    check(!mqttManager.registerTopic("korngva/{room}/sound_state").valid(), "unknown placeholder refused");
+    check(mqttManager.registerTopic("korngva/sound_monitor/second_floor/sound_state").index == soundState.index,
+          "same topic registered twice keeps its handle");
+    mqttManager.setTopicOptions("korngva/sound_monitor/second_floor/sound_state", MqttPublishOptions(0, false));
+    mqttManager.sendMessage(soundState, "quiet");
+    check(broker.waitForMessage("korngva/sound_monitor/second_floor/sound_state", "quiet", 5000), "published by handle");
+    check(!broker.retained("korngva/sound_monitor/second_floor/sound_state", nullptr),
+          "topic options set after registration apply to the handle");
+    std::thread([&]() { mqttManager.queueMessage(soundState, "loud"); }).join();
+    check(runUntil(mqttManager, [&]() {
+        return broker.waitForMessage("korngva/sound_monitor/second_floor/sound_state", "loud", 0);
+    }, 5000), "queued by handle and published by poll()");
+    check(!mqttManager.sendMessage(MqttTopic(), "lost").ok(), "invalid handle is not published");
+
+    std::vector<std::string> batched;
+    std::mutex batchedMutex;
+    broker.onPublish([&](const LoopbackBroker::Message &message) {
+        if (message.topic.compare(0, 14, "korngva/batch/") == 0) {
+            std::lock_guard<std::mutex> lock(batchedMutex);
+            batched.push_back(message.payload);
+        }
+    });
+    auto batchedCount = [&]() {
+        std::lock_guard<std::mutex> lock(batchedMutex);
+        return batched.size();
+    };
+    unsigned long writesBefore = mqttManager.batchWrites();
+    mqttManager.beginBatch();
+    for (int i = 0; i < 10; i++) {
+        MqttPublishHandle handle = mqttManager.sendMessage("korngva/batch/level", std::to_string(i).c_str(),
+                                                           MqttPublishOptions(0, false));
+        if (i == 0) {
+            check(handle.status == MqttDeliveryStatus::QUEUED, "batched message waits for endBatch()");
+        }
+    }
+    mqttManager.endBatch();
+    check(mqttManager.batchWrites() == writesBefore + 1, "batch written in one write");
+    check(runUntil(mqttManager, [&]() { return batchedCount() == 10; }, 5000), "all batched messages delivered");
+    mqttManager.setBatchWindow(20);
+    mqttManager.sendMessage("korngva/batch/level", "10", MqttPublishOptions(0, false));
+    mqttManager.sendMessage("korngva/batch/level", "11", MqttPublishOptions(0, false));
+    mqttManager.sendMessage("korngva/batch/alarm", "12", MqttPublishOptions(1, false)); // Flushes the batch first
+    mqttManager.sendMessage("korngva/batch/level", "13", MqttPublishOptions(0, false));
+    check(runUntil(mqttManager, [&]() { return batchedCount() == 14; }, 5000), "batch window flushed by poll()");
+    mqttManager.setBatchWindow(0);
+    {
+        std::lock_guard<std::mutex> lock(batchedMutex);
+        bool ordered = true;
+        for (size_t i = 0; i < batched.size(); i++) {
+            ordered = ordered && batched[i] == std::to_string(i);
+        }
+        check(ordered, "batched and unbatched messages arrive in order");
+    }
+
+    std::vector<std::string> limited;
+    std::mutex limitedMutex;
+    broker.onPublish([&](const LoopbackBroker::Message &message) {
+        if (message.topic.compare(0, 13, "korngva/rate/") == 0) {
+            std::lock_guard<std::mutex> lock(limitedMutex);
+            limited.push_back(message.topic.substr(13) + "=" + message.payload);
+        }
+    });
+    auto limitedCount = [&]() {
+        std::lock_guard<std::mutex> lock(limitedMutex);
+        return limited.size();
+    };
+    mqttManager.setTopicRateLimit("korngva/rate/drop", 1, 1, MqttRateLimitPolicy::DROP);
+    int refused = 0;
+    for (int i = 0; i < 3; i++) {
+        MqttPublishHandle handle = mqttManager.sendMessage("korngva/rate/drop", std::to_string(i).c_str(),
+                                                           MqttPublishOptions(0, false));
+        refused += handle.status == MqttDeliveryStatus::DROPPED;
+    }
+    check(refused == 2 && mqttManager.rateLimitStats().dropped == 2, "messages over a DROP limit are discarded");
+    mqttManager.setTopicRateLimit("korngva/rate/state", 10, 1, MqttRateLimitPolicy::COALESCE);
+    mqttManager.sendMessage("korngva/rate/state", "a", MqttPublishOptions(0, false));
+    mqttManager.sendMessage("korngva/rate/state", "b", MqttPublishOptions(0, false)); // Queued
+    mqttManager.sendMessage("korngva/rate/state", "c", MqttPublishOptions(0, false)); // Replaces b
+    check(mqttManager.rateLimitStats().coalesced == 1 && mqttManager.outboxSize() == 1,
+          "newer message replaces the queued one of its topic");
+    check(runUntil(mqttManager, [&]() { return limitedCount() == 3; }, 5000), "coalesced message released");
+    mqttManager.setRateLimit(50, 2, MqttRateLimitPolicy::QUEUE);
+    for (int i = 0; i < 6; i++) {
+        mqttManager.sendMessage("korngva/rate/queue", std::to_string(i).c_str(), MqttPublishOptions(0, false));
+    }
+    check(mqttManager.outboxSize() == 4 && mqttManager.rateLimitStats().queued == 5, "messages over the global limit queued");
+    check(runUntil(mqttManager, [&]() { return limitedCount() == 9; }, 5000), "queued messages released as tokens return");
+    mqttManager.setRateLimit(0, 0);
+    {
+        std::lock_guard<std::mutex> lock(limitedMutex);
+        const char *expected[] = {"drop=0", "state=a", "state=c", "queue=0", "queue=1", "queue=2", "queue=3", "queue=4",
+                                  "queue=5"};
+        bool ordered = limited.size() == 9;
+        for (size_t i = 0; ordered && i < 9; i++) {
+            ordered = limited[i] == expected[i];
+        }
+        check(ordered, "rate-limited messages arrive in order, without the dropped and replaced ones");
+    }
+    mqttManager.setTopicRateLimit("korngva/rate/slow", 1, 1, MqttRateLimitPolicy::QUEUE);
+    mqttManager.sendMessage("korngva/rate/slow", "0", MqttPublishOptions(0, false));
+    mqttManager.sendMessage("korngva/rate/slow", "1", MqttPublishOptions(0, false)); // Waits for a token
+    mqttManager.sendMessage("korngva/rate/other", "0", MqttPublishOptions(0, false));
+    check(runUntil(mqttManager, [&]() { return limitedCount() == 11; }, 500) && mqttManager.outboxSize() == 1,
+          "a topic waiting for its own tokens does not hold up other topics");
+    mqttManager.setTopicRateLimit("korngva/rate/slow", 0, 1);
+    check(runUntil(mqttManager, [&]() { return limitedCount() == 12; }, 5000), "held message released");
+
+    std::vector<std::string> lanes;
+    std::mutex lanesMutex;
+    broker.onPublish([&](const LoopbackBroker::Message &message) {
+        if (message.topic.compare(0, 13, "korngva/lane/") == 0) {
+            std::lock_guard<std::mutex> lock(lanesMutex);
+            lanes.push_back(message.payload);
+        }
+    });
+    auto lanesReceived = [&](const std::vector<std::string> &expected) {
+        bool done = runUntil(mqttManager, [&]() {
+            std::lock_guard<std::mutex> lock(lanesMutex);
+            return lanes.size() >= expected.size();
+        }, 5000);
+        std::lock_guard<std::mutex> lock(lanesMutex);
+        bool ordered = done && lanes == expected;
+        lanes.clear();
+        return ordered;
+    };
+    MqttPublishOptions bulk(0, false, nullptr, nullptr, MqttPriority::BULK);
+    MqttPublishOptions urgent(1, false, nullptr, nullptr, MqttPriority::URGENT);
+    mqttManager.setRateLimit(20, 1); // Builds a backlog: one message per 50 ms
+    for (int i = 0; i < 3; i++) {
+        mqttManager.sendMessage("korngva/lane/level", ("b" + std::to_string(i)).c_str(), bulk);
+    }
+    mqttManager.sendMessage("korngva/lane/alarm", "u0", urgent);
+    check(lanesReceived({"b0", "u0", "b1", "b2"}), "urgent message overtakes the bulk backlog");
+    mqttManager.setPrioritySchedule(MqttPrioritySchedule::WEIGHTED, 2, 1, 1);
+    mqttManager.setRateLimit(20, 1); // Full bucket again: b0 goes out at once
+    for (int i = 0; i < 5; i++) {
+        mqttManager.sendMessage("korngva/lane/level", ("b" + std::to_string(i)).c_str(), bulk);
+    }
+    for (int i = 0; i < 4; i++) {
+        mqttManager.sendMessage("korngva/lane/alarm", ("u" + std::to_string(i)).c_str(), urgent);
+    }
+    check(lanesReceived({"b0", "u0", "u1", "b1", "u2", "u3", "b2", "b3", "b4"}),
+          "weighted schedule alternates two urgent messages with one bulk message");
+    mqttManager.setPrioritySchedule(MqttPrioritySchedule::STRICT);
+    mqttManager.setRateLimit(0, 0);
+
+    backup.stop();
+    broker.stop();
+    Serial.println(failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
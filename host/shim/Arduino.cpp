@@ -0,0 +1,134 @@
+#include "Arduino.h"
+#include <stdarg.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+HardwareSerial Serial;
+
+namespace {
+
+const std::chrono::steady_clock::time_point programStart = std::chrono::steady_clock::now();
+const size_t uartFifoSize = 128; // ESP32 UART hardware FIFO
+std::mutex serialMutex;
+
+unsigned long long microsNow() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - programStart).count();
+}
+
+} // namespace
+
+unsigned long millis() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - programStart).count();
+}
+
+unsigned long micros() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - programStart).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+HardwareSerial::HardwareSerial()
+    : output(stdout),
+      baud(115200),
+      pacing(false),
+      busyUntil(0)
+{
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+    this->baud = baud ? baud : 115200;
+}
+
+void HardwareSerial::flush() {
+    fflush(output);
+}
+
+void HardwareSerial::setOutput(FILE *output) {
+    this->output = output;
+}
+
+void HardwareSerial::setBaudPacing(bool enabled) {
+    pacing = enabled;
+}
+
+// Emulate a UART with 8N1 framing: the writer blocks while more than a FIFO's worth is pending
+void HardwareSerial::pace(size_t bytes) {
+    if (!pacing) {
+        return;
+    }
+    unsigned long long wait;
+    {
+        std::lock_guard<std::mutex> lock(serialMutex);
+        unsigned long long now = microsNow();
+        unsigned long long byteTime = 10000000ULL / baud; // 10 bits per byte, in microseconds
+        if (busyUntil < now) {
+            busyUntil = now;
+        }
+        busyUntil += bytes * byteTime;
+        unsigned long long fifoTime = uartFifoSize * byteTime;
+        wait = busyUntil > now + fifoTime ? busyUntil - fifoTime : 0;
+    }
+    while (wait && microsNow() < wait) {
+        // Busy-wait: the Arduino core spins on the FIFO as well
+    }
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    pace(1);
+    return fputc(c, output) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+    pace(size);
+    return fwrite(buffer, 1, size, output);
+}
+
+size_t HardwareSerial::printf(const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) {
+        return 0;
+    }
+    return write((const uint8_t *)buffer, (size_t)length < sizeof(buffer) ? length : sizeof(buffer) - 1);
+}
+
+size_t HardwareSerial::print(const char *value) {
+    return write((const uint8_t *)value, strlen(value));
+}
+
+size_t HardwareSerial::print(char value) {
+    return write((uint8_t)value);
+}
+
+size_t HardwareSerial::print(int value) {
+    return printf("%d", value);
+}
+
+size_t HardwareSerial::print(unsigned int value) {
+    return printf("%u", value);
+}
+
+size_t HardwareSerial::print(long value) {
+    return printf("%ld", value);
+}
+
+size_t HardwareSerial::print(unsigned long value) {
+    return printf("%lu", value);
+}
+
+size_t HardwareSerial::print(double value) {
+    return printf("%.2f", value);
+}
+
+size_t HardwareSerial::println() {
+    return write((uint8_t)'\n');
+}
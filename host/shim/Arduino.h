@@ -0,0 +1,67 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+/*
+ * Minimal Arduino core for building MqttManager on a Linux host.
+ *
+ * Only what the library and the host tools use: millis()/micros()/delay() on
+ * top of the monotonic clock, a Serial object that writes to stdout and
+ * IPAddress.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IPAddress.h"
+
+#define ARDUINO_HOST_SHIM 1 // Lets the library pick its host implementations (threads, mutexes)
+
+unsigned long millis(); // Milliseconds since program start
+unsigned long micros(); // Microseconds since program start
+void delay(unsigned long ms);
+
+class HardwareSerial {
+public:
+    HardwareSerial();
+
+    void begin(unsigned long baud);
+    void flush();
+
+    // Host-only: send output somewhere other than stdout (e.g. /dev/null in benchmarks)
+    void setOutput(FILE *output);
+    // Host-only: block writers like a UART at the begin() baud rate with a 128-byte FIFO
+    void setBaudPacing(bool enabled);
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    size_t print(const char *value);
+    size_t print(char value);
+    size_t print(int value);
+    size_t print(unsigned int value);
+    size_t print(long value);
+    size_t print(unsigned long value);
+    size_t print(double value);
+
+    size_t println();
+    template <typename T>
+    size_t println(T value) {
+        size_t written = print(value);
+        return written + println();
+    }
+
+private:
+    FILE *output;
+    unsigned long baud;
+    bool pacing;
+    unsigned long long busyUntil; // micros() when the emulated UART finishes sending
+
+    void pace(size_t bytes);
+};
+
+extern HardwareSerial Serial;
+
+#endif // ARDUINO_H
@@ -0,0 +1,535 @@
+#include "AsyncMqttClient.h"
+#include "Arduino.h"
+#include "MqttWire.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t rxChunkSize = 1460;           // AsyncTCP hands payloads over one TCP segment at a time
+const unsigned long connackTimeout = 10000; // Give up on a broker that never answers CONNECT
+
+std::atomic<unsigned int> clientCounter(0);
+
+} // namespace
+
+AsyncMqttClientSimulator *AsyncMqttClient::simulator = nullptr;
+
+AsyncMqttClient::AsyncMqttClient()
+    : port(1883),
+      keepAlive(15),
+      cleanSession(true),
+      maxTopicLength(128),
+      hasCredentials(false),
+      willQos(0),
+      willRetain(false),
+      state(DISCONNECTED),
+      nextPacketId(1),
+      writes(0),
+      lastSend(0),
+      disconnectReason(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED),
+      closeConnection(false),
+      sock(-1),
+      connectRequested(false),
+      stopping(false)
+{
+    char id[32];
+    snprintf(id, sizeof(id), "host-%d-%u", (int)getpid(), clientCounter++);
+    clientId = id;
+}
+
+AsyncMqttClient::~AsyncMqttClient() {
+    {
+        std::lock_guard<std::mutex> lock(workerMutex);
+        stopping = true;
+    }
+    workerWake.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (sock >= 0) {
+            shutdown(sock, SHUT_RDWR);
+        }
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+AsyncMqttClient &AsyncMqttClient::setKeepAlive(uint16_t keepAlive) {
+    this->keepAlive = keepAlive;
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::setClientId(const char *clientId) {
+    this->clientId = clientId;
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::setCleanSession(bool cleanSession) {
+    this->cleanSession = cleanSession;
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::setMaxTopicLength(uint16_t maxTopicLength) {
+    this->maxTopicLength = maxTopicLength;
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::setCredentials(const char *username, const char *password) {
+    this->username = username ? username : "";
+    this->password = password ? password : "";
+    hasCredentials = username != nullptr;
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::setWill(const char *topic, uint8_t qos, bool retain, const char *payload,
+                                          size_t length) {
+    willTopic = topic ? topic : "";
+    if (payload && length == 0) {
+        length = strlen(payload);
+    }
+    willPayload.assign(payload ? payload : "", length);
+    willQos = qos;
+    willRetain = retain;
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::setServer(IPAddress ip, uint16_t port) {
+    char literal[16];
+    snprintf(literal, sizeof(literal), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    host = literal;
+    this->port = port;
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::setServer(const char *host, uint16_t port) {
+    this->host = host;
+    this->port = port;
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onConnect(AsyncMqttClientInternals::OnConnectUserCallback callback) {
+    connectCallbacks.push_back(callback);
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onDisconnect(AsyncMqttClientInternals::OnDisconnectUserCallback callback) {
+    disconnectCallbacks.push_back(callback);
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onSubscribe(AsyncMqttClientInternals::OnSubscribeUserCallback callback) {
+    subscribeCallbacks.push_back(callback);
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onUnsubscribe(AsyncMqttClientInternals::OnUnsubscribeUserCallback callback) {
+    unsubscribeCallbacks.push_back(callback);
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onMessage(AsyncMqttClientInternals::OnMessageUserCallback callback) {
+    messageCallbacks.push_back(callback);
+    return *this;
+}
+
+AsyncMqttClient &AsyncMqttClient::onPublish(AsyncMqttClientInternals::OnPublishUserCallback callback) {
+    publishCallbacks.push_back(callback);
+    return *this;
+}
+
+bool AsyncMqttClient::connected() const {
+    return state == CONNECTED;
+}
+
+const char *AsyncMqttClient::getClientId() const {
+    return clientId.c_str();
+}
+
+// Start connecting in the background; the outcome is reported through onConnect/onDisconnect
+void AsyncMqttClient::connect() {
+    State expected = DISCONNECTED;
+    if (!state.compare_exchange_strong(expected, CONNECTING)) {
+        return; // Already connected or a connection attempt is in progress
+    }
+    if (simulator) {
+        simulator->connectRequested(*this);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(workerMutex);
+    connectRequested = true;
+    if (!worker.joinable()) {
+        worker = std::thread(&AsyncMqttClient::run, this);
+    }
+    workerWake.notify_all();
+}
+
+void AsyncMqttClient::disconnect(bool force) {
+    if (simulator) {
+        if (state != DISCONNECTED) {
+            simulateDisconnect();
+        }
+        return;
+    }
+    if (state == CONNECTED && !force) {
+        sendPacket(std::string(1, (char)(MqttWire::DISCONNECT << 4)) + '\0');
+    }
+    if (state == CONNECTED || state == CONNECTING) {
+        state = DISCONNECTING;
+    }
+    std::lock_guard<std::mutex> lock(writeMutex);
+    if (sock >= 0) {
+        shutdown(sock, SHUT_RDWR); // Wakes the worker, which reports the disconnect
+    }
+}
+
+uint16_t AsyncMqttClient::subscribe(const char *topic, uint8_t qos) {
+    if (state != CONNECTED) {
+        return 0;
+    }
+    uint16_t packetId = allocatePacketId();
+    if (simulator) {
+        return packetId;
+    }
+    std::string body;
+    MqttWire::appendU16(body, packetId);
+    MqttWire::appendString(body, topic, strlen(topic));
+    body.push_back((char)qos);
+    return sendPacket(MqttWire::frame((MqttWire::SUBSCRIBE << 4) | 0x02, body)) ? packetId : 0;
+}
+
+uint16_t AsyncMqttClient::unsubscribe(const char *topic) {
+    if (state != CONNECTED) {
+        return 0;
+    }
+    uint16_t packetId = allocatePacketId();
+    if (simulator) {
+        return packetId;
+    }
+    std::string body;
+    MqttWire::appendU16(body, packetId);
+    MqttWire::appendString(body, topic, strlen(topic));
+    return sendPacket(MqttWire::frame((MqttWire::UNSUBSCRIBE << 4) | 0x02, body)) ? packetId : 0;
+}
+
+uint16_t AsyncMqttClient::publish(const char *topic, uint8_t qos, bool retain, const char *payload, size_t length,
+                                  bool dup, uint16_t message_id) {
+    if (state != CONNECTED) {
+        return 0;
+    }
+    if (payload && length == 0) {
+        length = strlen(payload); // Same convention as the Arduino library
+    }
+    uint16_t packetId = 0;
+    if (qos > 0) {
+        packetId = message_id ? message_id : allocatePacketId();
+    }
+    if (simulator) {
+        if (!simulator->publishRequested(*this, topic, qos, retain, payload, length, packetId)) {
+            return 0;
+        }
+        return qos > 0 ? packetId : 1;
+    }
+    std::string packet = MqttWire::publish(topic, strlen(topic), qos, retain, dup, packetId, payload, length);
+    if (!sendPacket(packet)) {
+        return 0;
+    }
+    return qos > 0 ? packetId : 1;
+}
+
+bool AsyncMqttClient::writeRaw(const uint8_t *data, size_t length) {
+    if (state != CONNECTED || simulator) {
+        return false; // The simulator sees packets through publish() only
+    }
+    return sendPacket(std::string((const char *)data, length));
+}
+
+void AsyncMqttClient::setSimulator(AsyncMqttClientSimulator *simulator) {
+    AsyncMqttClient::simulator = simulator;
+}
+
+void AsyncMqttClient::simulateConnect(bool sessionPresent) {
+    if (state != CONNECTING) {
+        return;
+    }
+    state = CONNECTED;
+    for (auto &callback : connectCallbacks) {
+        callback(sessionPresent);
+    }
+}
+
+void AsyncMqttClient::simulateDisconnect(AsyncMqttClientDisconnectReason reason) {
+    if (state == DISCONNECTED) {
+        return;
+    }
+    state = DISCONNECTED;
+    notifyDisconnect(reason);
+}
+
+void AsyncMqttClient::simulatePublishAck(uint16_t packetId) {
+    for (auto &callback : publishCallbacks) {
+        callback(packetId);
+    }
+}
+
+uint16_t AsyncMqttClient::allocatePacketId() {
+    uint16_t packetId = nextPacketId++;
+    if (packetId == 0) {
+        packetId = nextPacketId++; // 0 is not a valid packet identifier
+    }
+    return packetId;
+}
+
+bool AsyncMqttClient::sendPacket(const std::string &packet) {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    if (sock < 0) {
+        return false;
+    }
+    size_t sent = 0;
+    while (sent < packet.size()) {
+        ssize_t written = send(sock, packet.data() + sent, packet.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0) {
+            return false;
+        }
+        sent += written;
+    }
+    writes++;
+    lastSend = millis();
+    return true;
+}
+
+bool AsyncMqttClient::openSocket() {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+
+    addrinfo *addresses = nullptr;
+    if (getaddrinfo(host.c_str(), service, &hints, &addresses) != 0) {
+        return false;
+    }
+
+    int fd = -1;
+    for (addrinfo *address = addresses; address; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        return false;
+    }
+
+    int noDelay = 1; // Every packet goes out in its own segment, like lwIP after publish()
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    std::lock_guard<std::mutex> lock(writeMutex);
+    sock = fd;
+    return true;
+}
+
+void AsyncMqttClient::closeSocket() {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    if (sock >= 0) {
+        close(sock);
+        sock = -1;
+    }
+}
+
+void AsyncMqttClient::run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(workerMutex);
+            workerWake.wait(lock, [this] { return connectRequested || stopping; });
+            if (stopping) {
+                return;
+            }
+            connectRequested = false;
+        }
+        runConnection();
+    }
+}
+
+// Service one connection from TCP connect to close, then report the disconnect
+void AsyncMqttClient::runConnection() {
+    disconnectReason = AsyncMqttClientDisconnectReason::TCP_DISCONNECTED;
+    closeConnection = false;
+
+    if (state != CONNECTING || !openSocket()) {
+        state = DISCONNECTED;
+        notifyDisconnect(disconnectReason);
+        return;
+    }
+
+    std::string body;
+    MqttWire::appendString(body, "MQTT", 4);
+    body.push_back(4); // Protocol level 3.1.1
+    uint8_t flags = cleanSession ? 0x02 : 0;
+    if (!willTopic.empty()) {
+        flags |= 0x04 | ((willQos & 0x03) << 3) | (willRetain ? 0x20 : 0);
+    }
+    if (hasCredentials) {
+        flags |= 0x80 | (password.empty() ? 0 : 0x40);
+    }
+    body.push_back((char)flags);
+    MqttWire::appendU16(body, keepAlive);
+    MqttWire::appendString(body, clientId.data(), clientId.size());
+    if (!willTopic.empty()) {
+        MqttWire::appendString(body, willTopic.data(), willTopic.size());
+        MqttWire::appendString(body, willPayload.data(), willPayload.size());
+    }
+    if (hasCredentials) {
+        MqttWire::appendString(body, username.data(), username.size());
+        if (!password.empty()) {
+            MqttWire::appendString(body, password.data(), password.size());
+        }
+    }
+    sendPacket(MqttWire::frame(MqttWire::CONNECT << 4, body));
+
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        fd = sock;
+    }
+    unsigned long started = millis();
+    std::string buffer;
+    char chunk[4096];
+    while (!stopping && !closeConnection) {
+        pollfd descriptor;
+        descriptor.fd = fd;
+        descriptor.events = POLLIN;
+        descriptor.revents = 0;
+        if (poll(&descriptor, 1, 50) > 0) {
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                break;
+            }
+            buffer.append(chunk, received);
+
+            uint8_t header;
+            bool malformed;
+            while (!closeConnection && MqttWire::nextPacket(buffer, header, body, malformed)) {
+                handlePacket(header, body);
+            }
+            if (malformed) {
+                break;
+            }
+        }
+
+        unsigned long now = millis();
+        if (state == CONNECTING && now - started >= connackTimeout) {
+            break;
+        }
+        if (state == CONNECTED && keepAlive && now - lastSend >= keepAlive * 1000UL) {
+            sendPacket(std::string(1, (char)(MqttWire::PINGREQ << 4)) + '\0');
+        }
+    }
+
+    closeSocket();
+    state = DISCONNECTED;
+    if (!stopping) {
+        notifyDisconnect(disconnectReason);
+    }
+}
+
+void AsyncMqttClient::handlePacket(uint8_t header, const std::string &body) {
+    MqttWire::Reader reader(body);
+    switch (header >> 4) {
+    case MqttWire::CONNACK: {
+        bool sessionPresent = reader.u8() & 0x01;
+        uint8_t returnCode = reader.u8();
+        if (!reader.ok || returnCode != 0) {
+            disconnectReason = (AsyncMqttClientDisconnectReason)returnCode;
+            closeConnection = true;
+            return;
+        }
+        lastSend = millis();
+        state = CONNECTED;
+        for (auto &callback : connectCallbacks) {
+            callback(sessionPresent);
+        }
+        break;
+    }
+    case MqttWire::PUBLISH: {
+        AsyncMqttClientMessageProperties properties;
+        properties.qos = (header >> 1) & 0x03;
+        properties.dup = header & 0x08;
+        properties.retain = header & 0x01;
+        std::string topic = reader.str();
+        uint16_t packetId = properties.qos ? reader.u16() : 0;
+        std::string payload = reader.rest();
+        if (!reader.ok) {
+            closeConnection = true;
+            return;
+        }
+        if (properties.qos == 1) {
+            sendPacket(MqttWire::ack(MqttWire::PUBACK << 4, packetId));
+        } else if (properties.qos == 2) {
+            sendPacket(MqttWire::ack(MqttWire::PUBREC << 4, packetId));
+        }
+
+        // Hand the payload over in segment-sized chunks, as the Arduino library does
+        size_t total = payload.size();
+        size_t index = 0;
+        do {
+            size_t length = total - index < rxChunkSize ? total - index : rxChunkSize;
+            for (auto &callback : messageCallbacks) {
+                callback(&topic[0], &payload[0] + index, properties, length, index, total);
+            }
+            index += length;
+        } while (index < total);
+        break;
+    }
+    case MqttWire::PUBACK:
+    case MqttWire::PUBCOMP: {
+        uint16_t packetId = reader.u16();
+        for (auto &callback : publishCallbacks) {
+            callback(packetId);
+        }
+        break;
+    }
+    case MqttWire::PUBREC:
+        sendPacket(MqttWire::ack((MqttWire::PUBREL << 4) | 0x02, reader.u16()));
+        break;
+    case MqttWire::PUBREL:
+        sendPacket(MqttWire::ack(MqttWire::PUBCOMP << 4, reader.u16()));
+        break;
+    case MqttWire::SUBACK: {
+        uint16_t packetId = reader.u16();
+        uint8_t qos = reader.u8();
+        for (auto &callback : subscribeCallbacks) {
+            callback(packetId, qos);
+        }
+        break;
+    }
+    case MqttWire::UNSUBACK: {
+        uint16_t packetId = reader.u16();
+        for (auto &callback : unsubscribeCallbacks) {
+            callback(packetId);
+        }
+        break;
+    }
+    default:
+        break; // PINGRESP and anything a client does not expect
+    }
+}
+
+void AsyncMqttClient::notifyDisconnect(AsyncMqttClientDisconnectReason reason) {
+    for (auto &callback : disconnectCallbacks) {
+        callback(reason);
+    }
+}
@@ -0,0 +1,175 @@
+#ifndef ASYNCMQTTCLIENT_H
+#define ASYNCMQTTCLIENT_H
+
+/*
+ * Host (Linux) stand-in for marvinroger/AsyncMqttClient.
+ *
+ * Same public interface as the Arduino library, backed by a real MQTT 3.1.1
+ * client on a POSIX socket. A background thread plays the role of the async
+ * TCP task: it owns the connection, reads packets and runs the user callbacks,
+ * so callback code executes off the caller's thread exactly as on an ESP32.
+ * publish()/subscribe() may be called from any thread.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "IPAddress.h"
+
+#define ASYNC_MQTT_CLIENT_HOST_SHIM 1 // Lets host tools detect the shim
+
+enum class AsyncMqttClientDisconnectReason : uint8_t {
+    TCP_DISCONNECTED = 0,
+
+    MQTT_UNACCEPTABLE_PROTOCOL_VERSION = 1,
+    MQTT_IDENTIFIER_REJECTED = 2,
+    MQTT_SERVER_UNAVAILABLE = 3,
+    MQTT_MALFORMED_CREDENTIALS = 4,
+    MQTT_NOT_AUTHORIZED = 5,
+
+    ESP8266_NOT_ENOUGH_SPACE = 6,
+
+    TLS_BAD_FINGERPRINT = 7
+};
+
+struct AsyncMqttClientMessageProperties {
+    uint8_t qos;
+    bool dup;
+    bool retain;
+};
+
+namespace AsyncMqttClientInternals {
+typedef std::function<void(bool sessionPresent)> OnConnectUserCallback;
+typedef std::function<void(AsyncMqttClientDisconnectReason reason)> OnDisconnectUserCallback;
+typedef std::function<void(uint16_t packetId, uint8_t qos)> OnSubscribeUserCallback;
+typedef std::function<void(uint16_t packetId)> OnUnsubscribeUserCallback;
+typedef std::function<void(char *topic, char *payload, AsyncMqttClientMessageProperties properties, size_t len,
+                           size_t index, size_t total)> OnMessageUserCallback;
+typedef std::function<void(uint16_t packetId)> OnPublishUserCallback;
+} // namespace AsyncMqttClientInternals
+
+class AsyncMqttClient;
+
+/*
+ * Host-only: deterministic stand-in for the network. While a simulator is
+ * installed with AsyncMqttClient::setSimulator(), clients open no sockets and
+ * start no threads. connect() and publish() are reported to the simulator,
+ * which later drives the outcome through the client's simulate*() methods on
+ * its own thread and schedule, typically against a ManualClock.
+ */
+class AsyncMqttClientSimulator {
+public:
+    virtual ~AsyncMqttClientSimulator() {}
+    virtual void connectRequested(AsyncMqttClient &client) = 0; // Answer later with simulateConnect/Disconnect
+    // Return false to make publish() fail as if the client were out of memory
+    virtual bool publishRequested(AsyncMqttClient &client, const char *topic, uint8_t qos, bool retain,
+                                  const char *payload, size_t length, uint16_t packetId) {
+        (void)client; (void)topic; (void)qos; (void)retain; (void)payload; (void)length; (void)packetId;
+        return true;
+    }
+};
+
+class AsyncMqttClient {
+public:
+    AsyncMqttClient();
+    ~AsyncMqttClient();
+
+    AsyncMqttClient &setKeepAlive(uint16_t keepAlive);
+    AsyncMqttClient &setClientId(const char *clientId);
+    AsyncMqttClient &setCleanSession(bool cleanSession);
+    AsyncMqttClient &setMaxTopicLength(uint16_t maxTopicLength);
+    AsyncMqttClient &setCredentials(const char *username, const char *password = nullptr);
+    AsyncMqttClient &setWill(const char *topic, uint8_t qos, bool retain, const char *payload = nullptr,
+                             size_t length = 0);
+    AsyncMqttClient &setServer(IPAddress ip, uint16_t port);
+    AsyncMqttClient &setServer(const char *host, uint16_t port);
+
+    AsyncMqttClient &onConnect(AsyncMqttClientInternals::OnConnectUserCallback callback);
+    AsyncMqttClient &onDisconnect(AsyncMqttClientInternals::OnDisconnectUserCallback callback);
+    AsyncMqttClient &onSubscribe(AsyncMqttClientInternals::OnSubscribeUserCallback callback);
+    AsyncMqttClient &onUnsubscribe(AsyncMqttClientInternals::OnUnsubscribeUserCallback callback);
+    AsyncMqttClient &onMessage(AsyncMqttClientInternals::OnMessageUserCallback callback);
+    AsyncMqttClient &onPublish(AsyncMqttClientInternals::OnPublishUserCallback callback);
+
+    bool connected() const;
+    void connect();
+    void disconnect(bool force = false);
+    uint16_t subscribe(const char *topic, uint8_t qos);
+    uint16_t unsubscribe(const char *topic);
+    uint16_t publish(const char *topic, uint8_t qos, bool retain, const char *payload = nullptr,
+                     size_t length = 0, bool dup = false, uint16_t message_id = 0);
+
+    const char *getClientId() const;
+
+    // Host-only: number of send() calls made on the socket (one per packet written)
+    unsigned long writeCount() const { return writes.load(); }
+    // Host-only: write already encoded packets with one send() call; false when not connected (or simulated)
+    bool writeRaw(const uint8_t *data, size_t length);
+
+    // Host-only: route every client through a simulator instead of sockets (nullptr restores sockets)
+    static void setSimulator(AsyncMqttClientSimulator *simulator);
+    // Host-only, simulator side: complete a pending connect or drop the connection
+    void simulateConnect(bool sessionPresent = false);
+    void simulateDisconnect(AsyncMqttClientDisconnectReason reason = AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+    void simulatePublishAck(uint16_t packetId); // PUBACK/PUBCOMP for a QoS 1/2 publish
+
+private:
+    enum State { DISCONNECTED, CONNECTING, CONNECTED, DISCONNECTING };
+
+    std::string host;
+    uint16_t port;
+    uint16_t keepAlive;
+    bool cleanSession;
+    uint16_t maxTopicLength;
+    std::string clientId;
+    std::string username;
+    std::string password;
+    bool hasCredentials;
+    std::string willTopic;
+    std::string willPayload;
+    uint8_t willQos;
+    bool willRetain;
+
+    std::vector<AsyncMqttClientInternals::OnConnectUserCallback> connectCallbacks;
+    std::vector<AsyncMqttClientInternals::OnDisconnectUserCallback> disconnectCallbacks;
+    std::vector<AsyncMqttClientInternals::OnSubscribeUserCallback> subscribeCallbacks;
+    std::vector<AsyncMqttClientInternals::OnUnsubscribeUserCallback> unsubscribeCallbacks;
+    std::vector<AsyncMqttClientInternals::OnMessageUserCallback> messageCallbacks;
+    std::vector<AsyncMqttClientInternals::OnPublishUserCallback> publishCallbacks;
+
+    std::atomic<State> state;
+    std::atomic<uint16_t> nextPacketId;
+    std::atomic<unsigned long> writes;
+    std::atomic<unsigned long> lastSend; // millis() of the last packet written, for keep-alive
+
+    AsyncMqttClientDisconnectReason disconnectReason; // Worker-only: reason reported when the connection ends
+    bool closeConnection; // Worker-only: set by handlePacket to end the connection
+
+    std::mutex writeMutex; // Serializes socket writes and guards sock
+    int sock;
+
+    std::mutex workerMutex;
+    std::condition_variable workerWake;
+    bool connectRequested;
+    std::atomic<bool> stopping;
+    std::thread worker;
+
+    static AsyncMqttClientSimulator *simulator;
+
+    void run(); // Worker thread: waits for connect() and services one connection at a time
+    void runConnection();
+    bool openSocket();
+    void closeSocket();
+    bool sendPacket(const std::string &packet);
+    void handlePacket(uint8_t header, const std::string &body);
+    void notifyDisconnect(AsyncMqttClientDisconnectReason reason);
+    uint16_t allocatePacketId();
+};
+
+#endif // ASYNCMQTTCLIENT_H
@@ -0,0 +1,46 @@
+#ifndef IPADDRESS_H
+#define IPADDRESS_H
+
+/*
+ * Host stand-in for the Arduino IPAddress class (IPv4 only), with the members
+ * the library uses.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+class IPAddress {
+public:
+    IPAddress() : bytes{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+
+    uint8_t operator[](int index) const { return bytes[index]; }
+    bool operator==(const IPAddress &other) const {
+        return bytes[0] == other.bytes[0] && bytes[1] == other.bytes[1] && bytes[2] == other.bytes[2] &&
+               bytes[3] == other.bytes[3];
+    }
+    bool operator!=(const IPAddress &other) const { return !(*this == other); }
+
+    // Parse a dotted-quad literal; returns false (and leaves the address alone) for anything else
+    bool fromString(const char *address) {
+        unsigned int parts[4];
+        char extra;
+        if (sscanf(address, "%u.%u.%u.%u%c", &parts[0], &parts[1], &parts[2], &parts[3], &extra) != 4) {
+            return false;
+        }
+        for (int i = 0; i < 4; i++) {
+            if (parts[i] > 255) {
+                return false;
+            }
+        }
+        for (int i = 0; i < 4; i++) {
+            bytes[i] = (uint8_t)parts[i];
+        }
+        return true;
+    }
+
+private:
+    uint8_t bytes[4];
+};
+
+#endif // IPADDRESS_H
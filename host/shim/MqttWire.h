@@ -0,0 +1,164 @@
+#ifndef MQTTWIRE_H
+#define MQTTWIRE_H
+
+/*
+ * MQTT 3.1.1 wire helpers shared by the host AsyncMqttClient shim and the
+ * loopback broker. Only what those two need: fixed header packing, UTF-8
+ * string fields and a frame splitter for a byte stream.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace MqttWire {
+
+enum PacketType : uint8_t {
+    CONNECT = 1,
+    CONNACK = 2,
+    PUBLISH = 3,
+    PUBACK = 4,
+    PUBREC = 5,
+    PUBREL = 6,
+    PUBCOMP = 7,
+    SUBSCRIBE = 8,
+    SUBACK = 9,
+    UNSUBSCRIBE = 10,
+    UNSUBACK = 11,
+    PINGREQ = 12,
+    PINGRESP = 13,
+    DISCONNECT = 14
+};
+
+// Append the variable-length "remaining length" field
+inline void appendLength(std::string &out, size_t length) {
+    do {
+        uint8_t digit = length % 128;
+        length /= 128;
+        if (length > 0) {
+            digit |= 0x80;
+        }
+        out.push_back((char)digit);
+    } while (length > 0);
+}
+
+inline void appendU16(std::string &out, uint16_t value) {
+    out.push_back((char)(value >> 8));
+    out.push_back((char)(value & 0xFF));
+}
+
+inline void appendString(std::string &out, const char *data, size_t length) {
+    appendU16(out, (uint16_t)length);
+    out.append(data, length);
+}
+
+// Fixed header byte plus remaining length, followed by the body
+inline std::string frame(uint8_t header, const std::string &body) {
+    std::string packet;
+    packet.reserve(body.size() + 5);
+    packet.push_back((char)header);
+    appendLength(packet, body.size());
+    packet += body;
+    return packet;
+}
+
+// Two-byte packets that only carry a packet identifier (PUBACK, PUBREL, ...)
+inline std::string ack(uint8_t header, uint16_t packetId) {
+    std::string body;
+    appendU16(body, packetId);
+    return frame(header, body);
+}
+
+// Encode a complete PUBLISH packet
+inline std::string publish(const char *topic, size_t topicLength, uint8_t qos, bool retain, bool dup,
+                           uint16_t packetId, const char *payload, size_t length) {
+    std::string body;
+    body.reserve(topicLength + length + 4);
+    appendString(body, topic, topicLength);
+    if (qos > 0) {
+        appendU16(body, packetId);
+    }
+    body.append(payload ? payload : "", length);
+    uint8_t header = (PUBLISH << 4) | (dup ? 0x08 : 0) | ((qos & 0x03) << 1) | (retain ? 0x01 : 0);
+    return frame(header, body);
+}
+
+/*
+ * Try to cut one packet off the front of a receive buffer. Returns true and
+ * fills header/body when a whole packet is available, false when more bytes
+ * are needed. Sets malformed for an invalid remaining length.
+ */
+inline bool nextPacket(std::string &buffer, uint8_t &header, std::string &body, bool &malformed) {
+    malformed = false;
+    if (buffer.size() < 2) {
+        return false;
+    }
+    size_t length = 0;
+    size_t multiplier = 1;
+    size_t pos = 1;
+    while (true) {
+        if (pos >= buffer.size()) {
+            return false;
+        }
+        if (pos > 4) {
+            malformed = true;
+            return false;
+        }
+        uint8_t digit = (uint8_t)buffer[pos++];
+        length += (digit & 0x7F) * multiplier;
+        multiplier *= 128;
+        if (!(digit & 0x80)) {
+            break;
+        }
+    }
+    if (buffer.size() < pos + length) {
+        return false;
+    }
+    header = (uint8_t)buffer[0];
+    body.assign(buffer, pos, length);
+    buffer.erase(0, pos + length);
+    return true;
+}
+
+// Sequential reader for packet bodies; any overrun sets ok to false
+struct Reader {
+    const std::string &data;
+    size_t pos;
+    bool ok;
+
+    explicit Reader(const std::string &body) : data(body), pos(0), ok(true) {}
+
+    uint8_t u8() {
+        if (pos + 1 > data.size()) {
+            ok = false;
+            return 0;
+        }
+        return (uint8_t)data[pos++];
+    }
+
+    uint16_t u16() {
+        uint16_t high = u8();
+        return (uint16_t)((high << 8) | u8());
+    }
+
+    std::string str() {
+        uint16_t length = u16();
+        if (!ok || pos + length > data.size()) {
+            ok = false;
+            return std::string();
+        }
+        std::string value(data, pos, length);
+        pos += length;
+        return value;
+    }
+
+    std::string rest() {
+        std::string value(data, pos < data.size() ? pos : data.size());
+        pos = data.size();
+        return value;
+    }
+};
+
+} // namespace MqttWire
+
+#endif // MQTTWIRE_H
@@ -0,0 +1,23 @@
+#include "WiFi.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+
+WiFiClass WiFi;
+
+int WiFiClass::hostByName(const char *host, IPAddress &address) {
+    lookups++;
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+    if (getaddrinfo(host, nullptr, &hints, &result) != 0 || !result) {
+        return 0;
+    }
+    const uint8_t *bytes = (const uint8_t *)&((sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+    address = IPAddress(bytes[0], bytes[1], bytes[2], bytes[3]);
+    freeaddrinfo(result);
+    return 1;
+}
@@ -0,0 +1,25 @@
+#ifndef WIFI_H
+#define WIFI_H
+
+/*
+ * Host stand-in for the ESP32 WiFi object. The host is always "connected";
+ * only name resolution is provided, through getaddrinfo().
+ */
+
+#include "IPAddress.h"
+
+class WiFiClass {
+public:
+    // Resolve a host name to an IPv4 address; returns 1 on success like the ESP32 core
+    int hostByName(const char *host, IPAddress &address);
+
+    // Host-only: number of hostByName() calls, to observe DNS caching
+    unsigned long lookupCount() const { return lookups; }
+
+private:
+    unsigned long lookups = 0;
+};
+
+extern WiFiClass WiFi;
+
+#endif // WIFI_H
@@ -0,0 +1,95 @@
+#include "SimNetwork.h"
+
+SimNetwork::SimNetwork(ManualClock &clock)
+    : connectAttempts(0),
+      connectFailures(0),
+      connects(0),
+      published(0),
+      lostInTransit(0),
+      refused(0),
+      clock(clock),
+      up(true),
+      connectLatency(150),
+      connectTimeout(3000),
+      detectionDelay(5000),
+      acceptRate(0),
+      rateSecond(0),
+      acceptedInSecond(0)
+{
+    AsyncMqttClient::setSimulator(this);
+}
+
+SimNetwork::~SimNetwork() {
+    AsyncMqttClient::setSimulator(nullptr);
+}
+
+void SimNetwork::setLinkUp(bool up) {
+    if (this->up == up) {
+        return;
+    }
+    this->up = up;
+    if (!up) {
+        for (AsyncMqttClient *client : connected) {
+            Event event = {LINK_LOSS, client, true};
+            events.insert(std::make_pair(clock.millis() + detectionDelay, event));
+        }
+    }
+}
+
+void SimNetwork::step() {
+    unsigned long now = clock.millis();
+    while (!events.empty() && events.begin()->first <= now) {
+        Event event = events.begin()->second;
+        events.erase(events.begin());
+
+        switch (event.type) {
+        case CONNECT_RESULT:
+            if (up && event.accepted) {
+                connects++;
+                connected.insert(event.client);
+                event.client->simulateConnect(false);
+            } else {
+                connectFailures++;
+                event.client->simulateDisconnect(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+            }
+            break;
+        case LINK_LOSS:
+            // A link that came back before the client noticed keeps the connection alive
+            if (!up && connected.erase(event.client)) {
+                event.client->simulateDisconnect(AsyncMqttClientDisconnectReason::TCP_DISCONNECTED);
+            }
+            break;
+        }
+    }
+}
+
+void SimNetwork::connectRequested(AsyncMqttClient &client) {
+    connectAttempts++;
+    bool accepted = up;
+    if (up && acceptRate) {
+        unsigned long second = clock.millis() / 1000;
+        if (second != rateSecond) {
+            rateSecond = second;
+            acceptedInSecond = 0;
+        }
+        accepted = acceptedInSecond < acceptRate;
+        if (accepted) {
+            acceptedInSecond++;
+        } else {
+            refused++;
+        }
+    }
+    Event event = {CONNECT_RESULT, &client, accepted};
+    events.insert(std::make_pair(clock.millis() + (up ? connectLatency : connectTimeout), event));
+}
+
+bool SimNetwork::publishRequested(AsyncMqttClient &client, const char *topic, uint8_t qos, bool retain,
+                                  const char *payload, size_t length, uint16_t packetId) {
+    (void)client; (void)topic; (void)qos; (void)retain; (void)payload; (void)length; (void)packetId;
+    if (up) {
+        published++;
+    } else {
+        lostInTransit++;
+    }
+    return true;
+}
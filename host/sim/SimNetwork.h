@@ -0,0 +1,64 @@
+#ifndef SIMNETWORK_H
+#define SIMNETWORK_H
+
+/*
+ * Discrete-time network model for host simulations.
+ *
+ * Installed as the AsyncMqttClient simulator, it decides the fate of every
+ * connect() and publish() from a link state that the simulation toggles, and
+ * delivers the outcomes when the shared ManualClock reaches their due time.
+ * Callbacks therefore run inside step(), on the simulation thread, in a fully
+ * deterministic order.
+ */
+
+#include <AsyncMqttClient.h>
+#include <MqttClock.h>
+#include <map>
+#include <set>
+
+class SimNetwork : public AsyncMqttClientSimulator {
+public:
+    explicit SimNetwork(ManualClock &clock);
+    ~SimNetwork();
+
+    void setConnectLatency(unsigned long ms) { connectLatency = ms; }   // CONNECT to CONNACK when the link is up
+    void setConnectTimeout(unsigned long ms) { connectTimeout = ms; }   // Until a failed attempt is reported
+    void setDetectionDelay(unsigned long ms) { detectionDelay = ms; }   // Until clients notice a dead link
+    void setAcceptRate(unsigned long perSecond) { acceptRate = perSecond; } // Broker CONNECT capacity (0 = unlimited)
+
+    void setLinkUp(bool up); // Taking the link down drops connected clients after the detection delay
+    bool linkUp() const { return up; }
+    void step(); // Deliver every outcome due at the current clock time
+
+    void connectRequested(AsyncMqttClient &client) override;
+    bool publishRequested(AsyncMqttClient &client, const char *topic, uint8_t qos, bool retain,
+                          const char *payload, size_t length, uint16_t packetId) override;
+
+    unsigned long connectAttempts;  // connect() calls
+    unsigned long connectFailures;  // Attempts that ended in a disconnect
+    unsigned long connects;         // Attempts that ended in a connection
+    unsigned long published;        // Publishes made while the link was up
+    unsigned long lostInTransit;    // Publishes made on a dead link before it was detected
+    unsigned long refused;          // Attempts over the accept rate, refused by the busy broker
+
+private:
+    enum EventType { CONNECT_RESULT, LINK_LOSS };
+    struct Event {
+        EventType type;
+        AsyncMqttClient *client;
+        bool accepted; // Link up and broker below its accept rate when the attempt started
+    };
+
+    ManualClock &clock;
+    bool up;
+    unsigned long connectLatency;
+    unsigned long connectTimeout;
+    unsigned long detectionDelay;
+    unsigned long acceptRate;
+    unsigned long rateSecond;   // Clock second the accept count belongs to
+    unsigned long acceptedInSecond;
+    std::multimap<unsigned long, Event> events; // Due time -> outcome, in scheduling order per time
+    std::set<AsyncMqttClient *> connected;
+};
+
+#endif // SIMNETWORK_H
@@ -0,0 +1,171 @@
+/*
+ * Fleet-scale reconnect storm simulation, run in virtual time.
+ *
+ * Thousands of MqttManager instances share one ManualClock and one SimNetwork.
+ * They boot at random times, connect, and then the broker restarts: every
+ * connection drops at the same instant, the broker is unreachable for a while
+ * and, once back, accepts only a limited number of CONNECTs per second. The
+ * run is repeated for each backoff policy and reports how the reconnect
+ * attempts are spread over time and how long the fleet takes to recover.
+ *
+ *     ./mqttmanager_fleet_sim [--devices N] [--restart-ms MS] [--accept-rate N] [--seed S]
+ */
+
+#include <Arduino.h>
+#include <MqttManager.h>
+#include <stdio.h>
+#include <memory>
+#include <random>
+#include <vector>
+#include "BenchUtil.h"
+#include "SimNetwork.h"
+
+namespace {
+
+const unsigned long loopInterval = 50;    // reconnect() cadence on every device
+const unsigned long bootWindow = 30000;   // Devices power up spread over this long
+const unsigned long restartAt = 60000;    // Broker restart, once the whole fleet is connected
+const unsigned long giveUpAfter = 1800000; // Stop measuring if the fleet has not recovered by then
+
+enum Policy { EXPONENTIAL, FULL_JITTER, DECORRELATED_JITTER };
+const char *policyNames[] = {"exponential", "full jitter", "decorrelated"};
+
+std::unique_ptr<MqttBackoff> makeBackoff(Policy policy) {
+    switch (policy) {
+    case FULL_JITTER:
+        return std::unique_ptr<MqttBackoff>(new FullJitterBackoff(1000, 32000));
+    case DECORRELATED_JITTER:
+        return std::unique_ptr<MqttBackoff>(new DecorrelatedJitterBackoff(1000, 32000));
+    default:
+        return std::unique_ptr<MqttBackoff>(new ExponentialBackoff(1000, 32000));
+    }
+}
+
+struct Device {
+    std::unique_ptr<MqttManager> manager;
+    std::unique_ptr<MqttBackoff> backoff;
+    unsigned long bootAt;
+    bool booted;
+    unsigned long reconnectedAt; // 0 until connected again after the restart
+};
+
+void run(Policy policy, size_t deviceCount, unsigned long restartLength, unsigned long acceptRate,
+         unsigned long seed) {
+    ManualClock clock(1);
+    SimNetwork network(clock);
+    network.setDetectionDelay(0);  // The broker closes every socket when it goes down
+    network.setConnectTimeout(100); // Connection refused while it is down
+    network.setAcceptRate(acceptRate);
+
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<unsigned long> bootTime(0, bootWindow - 1);
+    std::vector<Device> devices(deviceCount);
+    for (size_t i = 0; i < deviceCount; i++) {
+        char clientId[32];
+        snprintf(clientId, sizeof(clientId), "sensor-%05zu", i);
+        Device &device = devices[i];
+        device.manager.reset(new MqttManager());
+        device.backoff = makeBackoff(policy);
+        device.manager->setClock(&clock);
+        device.manager->setServer("192.168.1.113", 1883);
+        device.manager->setLwt("fleet/status");
+        device.manager->setClientId(clientId);
+        device.manager->setBackoff(device.backoff.get());
+        device.bootAt = bootTime(random);
+        device.booted = false;
+        device.reconnectedAt = 0;
+    }
+
+    std::vector<unsigned long> attemptsPerSecond; // Connect attempts once the broker is back
+    unsigned long attemptsAtReturn = 0;
+    unsigned long attemptsBefore = 0;
+    unsigned long refusedBefore = 0;
+    unsigned long restartEnd = restartAt + restartLength;
+    size_t recovered = 0;
+    bool restarted = false;
+
+    while (clock.millis() < restartEnd + giveUpAfter && recovered < deviceCount) {
+        clock.advance(loopInterval);
+        unsigned long now = clock.millis();
+
+        if (!restarted && now >= restartAt) {
+            restarted = true;
+            attemptsBefore = network.connectAttempts;
+            refusedBefore = network.refused;
+            network.setLinkUp(false);
+        } else if (restarted && !network.linkUp() && now >= restartEnd) {
+            attemptsAtReturn = network.connectAttempts;
+            network.setLinkUp(true);
+        }
+        network.step();
+
+        for (Device &device : devices) {
+            if (!device.booted) {
+                if (now >= device.bootAt) {
+                    device.booted = true;
+                    device.manager->connect();
+                }
+                continue;
+            }
+            device.manager->reconnect();
+            if (restarted && !device.reconnectedAt && device.manager->isConnected()) {
+                device.reconnectedAt = now;
+                recovered++;
+            }
+        }
+
+        if (restarted && network.linkUp()) {
+            size_t second = (now - restartEnd) / 1000;
+            if (attemptsPerSecond.size() <= second) {
+                attemptsPerSecond.resize(second + 1, 0);
+            }
+            attemptsPerSecond[second] = network.connectAttempts - attemptsAtReturn; // Cumulative for now
+        }
+    }
+
+    unsigned long peak = 0;
+    unsigned long busySeconds = 0;
+    unsigned long previous = 0;
+    for (unsigned long &count : attemptsPerSecond) {
+        unsigned long cumulative = count;
+        count -= previous;
+        previous = cumulative;
+        peak = count > peak ? count : peak;
+        busySeconds += count > acceptRate ? 1 : 0;
+    }
+
+    std::vector<uint64_t> recovery; // Broker back -> device connected, in nanoseconds for BenchUtil
+    for (const Device &device : devices) {
+        if (device.reconnectedAt) {
+            recovery.push_back((uint64_t)(device.reconnectedAt - restartEnd) * 1000000ULL);
+        }
+    }
+    BenchUtil::Percentiles lag = BenchUtil::percentiles(recovery);
+
+    printf("%-13s %9lu %9lu %7lu %7lu %7.1f %8.1f %8.1f %9zu\n", policyNames[policy],
+           network.connectAttempts - attemptsBefore, network.refused - refusedBefore, peak, busySeconds,
+           lag.p50 / 1e6, lag.p99 / 1e6, lag.max / 1e6, deviceCount - recovered);
+    fflush(stdout);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    size_t devices = BenchUtil::option(argc, argv, "--devices", 4000);
+    unsigned long restartLength = BenchUtil::option(argc, argv, "--restart-ms", 20000);
+    unsigned long acceptRate = BenchUtil::option(argc, argv, "--accept-rate", 400);
+    unsigned long seed = BenchUtil::option(argc, argv, "--seed", 1);
+
+    FILE *devNull = fopen("/dev/null", "w");
+    Serial.setOutput(devNull ? devNull : stdout);
+
+    printf("%zu devices, broker down for %.1f s, accepts %lu CONNECTs/s, seed %lu\n", devices,
+           restartLength / 1000.0, acceptRate, seed);
+    printf("(attempts and refusals from the restart on; peak/s, seconds over capacity and recovery\n"
+           " from when the broker is back)\n");
+    printf("policy         attempts   refused  peak/s  >cap s  p50(s)   p99(s)   max(s)  stranded\n");
+    run(EXPONENTIAL, devices, restartLength, acceptRate, seed);
+    run(FULL_JITTER, devices, restartLength, acceptRate, seed);
+    run(DECORRELATED_JITTER, devices, restartLength, acceptRate, seed);
+    return 0;
+}
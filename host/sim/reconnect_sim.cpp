@@ -0,0 +1,122 @@
+/*
+ * Reconnect/backoff simulation for a single device over days of flapping
+ * connectivity, run in virtual time.
+ *
+ * A ManualClock drives MqttManager and the SimNetwork model. The link goes
+ * down at random (seeded, so runs are repeatable) with a mix of short blips,
+ * medium outages and long outages. The device calls reconnect() every 50 ms
+ * and publishes a reading every 10 s, like examples/example.cpp.
+ *
+ *     ./mqttmanager_reconnect_sim [--days N] [--seed S]
+ */
+
+#include <Arduino.h>
+#include <MqttManager.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include "BenchUtil.h"
+#include "SimNetwork.h"
+
+namespace {
+
+const unsigned long loopInterval = 50;       // reconnect() cadence
+const unsigned long publishInterval = 10000; // Telemetry cadence
+
+// Outage length: mostly Wi-Fi blips, sometimes an AP reboot, rarely a long outage
+unsigned long outageLength(std::mt19937 &random) {
+    std::uniform_real_distribution<double> pick(0.0, 1.0);
+    double kind = pick(random);
+    if (kind < 0.70) {
+        return std::uniform_int_distribution<unsigned long>(1000, 10000)(random);
+    }
+    if (kind < 0.95) {
+        return std::uniform_int_distribution<unsigned long>(30000, 300000)(random);
+    }
+    return std::uniform_int_distribution<unsigned long>(600000, 3600000)(random);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    unsigned long days = BenchUtil::option(argc, argv, "--days", 7);
+    unsigned long seed = BenchUtil::option(argc, argv, "--seed", 1);
+    unsigned long duration = days * 24UL * 3600UL * 1000UL;
+
+    FILE *devNull = fopen("/dev/null", "w");
+    Serial.setOutput(devNull ? devNull : stdout); // Thousands of log lines per simulated day
+
+    ManualClock clock(1); // Start past zero so the first reconnect() is not gated by the backoff
+    SimNetwork network(clock);
+    std::mt19937 random(seed);
+    std::exponential_distribution<double> uptime(1.0 / (30 * 60 * 1000.0)); // Mean 30 minutes between outages
+
+    MqttManager manager;
+    manager.setClock(&clock);
+    manager.setServer("192.168.1.113", 1883);
+    manager.setLwt("korngva/sound_monitor/device_status");
+    manager.connect();
+
+    unsigned long outages = 0;
+    unsigned long downtime = 0;
+    unsigned long nextChange = clock.millis() + (unsigned long)uptime(random);
+    unsigned long linkRestored = 0; // When the link last came back, 0 while waiting for nothing
+    unsigned long disconnectedTime = 0;
+    unsigned long readings = 0;
+    std::vector<uint64_t> reconnectLag; // Link back up -> MQTT connected, in nanoseconds for BenchUtil
+    bool wasConnected = false;
+    unsigned long lastPublish = 0;
+
+    uint64_t wallStart = BenchUtil::nanos();
+    while (clock.millis() < duration) {
+        clock.advance(loopInterval);
+        unsigned long now = clock.millis();
+
+        if (now >= nextChange) {
+            if (network.linkUp()) {
+                unsigned long length = outageLength(random);
+                network.setLinkUp(false);
+                outages++;
+                downtime += length;
+                nextChange = now + length;
+            } else {
+                network.setLinkUp(true);
+                linkRestored = now;
+                nextChange = now + (unsigned long)uptime(random);
+            }
+        }
+        network.step();
+
+        manager.reconnect();
+        if (now - lastPublish >= publishInterval) {
+            manager.sendMessage("korngva/sound_monitor/first_floor/sound_state", "42");
+            readings++;
+            lastPublish = now;
+        }
+
+        bool isConnected = manager.isConnected();
+        if (!isConnected) {
+            disconnectedTime += loopInterval;
+        }
+        if (isConnected && !wasConnected && linkRestored) {
+            reconnectLag.push_back((uint64_t)(now - linkRestored) * 1000000ULL);
+            linkRestored = 0;
+        }
+        wasConnected = isConnected;
+    }
+    double wallSeconds = (BenchUtil::nanos() - wallStart) / 1e9;
+    BenchUtil::Percentiles lag = BenchUtil::percentiles(reconnectLag);
+
+    printf("simulated %lu day(s) in %.2f s of wall time (%.0fx), seed %lu\n", days, wallSeconds,
+           duration / 1000.0 / wallSeconds, seed);
+    printf("outages:             %lu, link down %.2f%% of the time\n", outages, 100.0 * downtime / duration);
+    printf("MQTT disconnected:   %.2f%% of the time\n", 100.0 * disconnectedTime / duration);
+    printf("connect attempts:    %lu (%lu failed, %lu succeeded)\n", network.connectAttempts,
+           network.connectFailures, network.connects);
+    printf("reconnect lag:       p50 %.1f s, p99 %.1f s, max %.1f s after the link came back\n", lag.p50 / 1e6,
+           lag.p99 / 1e6, lag.max / 1e6);
+    printf("readings:            %lu sent, %lu published, %lu lost on a dead link, %lu dropped by the outbox, "
+           "%zu still queued\n", readings, network.published, network.lostInTransit, manager.outboxDropped(),
+           manager.outboxSize());
+    return 0;
+}
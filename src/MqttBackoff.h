@@ -0,0 +1,104 @@
+#ifndef MQTTBACKOFF_H
+#define MQTTBACKOFF_H
+
+#include <stdint.h>
+#include "MqttMessage.h"
+
+/*
+ * Reconnect delay policy used by MqttManager::reconnect().
+ *
+ * After a connection is lost the manager waits firstDelay() before the first
+ * attempt and nextDelay() after every failed one; reset() is called once the
+ * broker accepts the connection. Jittered policies spread a fleet's attempts
+ * out in time so a broker restart is not followed by synchronized waves of
+ * reconnects. They are seeded per device (MqttManager seeds them from the
+ * client ID), so two devices never share a sequence but a given device
+ * replays the same one.
+ */
+class MqttBackoff {
+public:
+    MqttBackoff(unsigned long baseMs, unsigned long capMs) : base(baseMs), cap(capMs), state(1) {}
+    virtual ~MqttBackoff() {}
+
+    virtual void reset() = 0;                // Connected: start over
+    virtual unsigned long firstDelay() = 0;  // Milliseconds from losing the connection to the first attempt
+    virtual unsigned long nextDelay() = 0;   // Milliseconds after a failed attempt
+
+    void seed(uint32_t value) { state = value ? value : 1; } // xorshift needs a non-zero state
+
+    // Turn a client ID into a seed
+    static uint32_t seedFrom(const char *text) { return mqttHash(text); }
+
+protected:
+    unsigned long base; // Smallest delay the policy works from
+    unsigned long cap;  // Largest delay it returns
+
+    // Uniform in [low, high]
+    unsigned long random(unsigned long low, unsigned long high) {
+        state ^= state << 13; // xorshift32: tiny and good enough to decorrelate devices
+        state ^= state >> 17;
+        state ^= state << 5;
+        return high > low ? low + state % (high - low + 1) : low;
+    }
+
+private:
+    uint32_t state;
+};
+
+// Doubling without jitter, the original MqttManager behavior: 0, 2 s, 4 s, ... up to the cap
+class ExponentialBackoff : public MqttBackoff {
+public:
+    ExponentialBackoff(unsigned long baseMs = 1000, unsigned long capMs = 32000)
+        : MqttBackoff(baseMs, capMs), current(baseMs) {}
+
+    void reset() override { current = base; }
+    unsigned long firstDelay() override { return 0; }
+    unsigned long nextDelay() override {
+        if (current < cap) {
+            current *= 2;
+        }
+        return current < cap ? current : cap;
+    }
+
+private:
+    unsigned long current;
+};
+
+// "Full jitter": uniform in [0, min(cap, base * 2^attempt)]
+class FullJitterBackoff : public MqttBackoff {
+public:
+    FullJitterBackoff(unsigned long baseMs = 1000, unsigned long capMs = 32000)
+        : MqttBackoff(baseMs, capMs), ceiling(baseMs) {}
+
+    void reset() override { ceiling = base; }
+    unsigned long firstDelay() override { return random(0, base); }
+    unsigned long nextDelay() override {
+        if (ceiling < cap) {
+            ceiling *= 2;
+        }
+        return random(0, ceiling < cap ? ceiling : cap);
+    }
+
+private:
+    unsigned long ceiling; // Upper bound of the current attempt
+};
+
+// "Decorrelated jitter": uniform in [base, previous * 3], capped; grows without lock-step doubling
+class DecorrelatedJitterBackoff : public MqttBackoff {
+public:
+    DecorrelatedJitterBackoff(unsigned long baseMs = 1000, unsigned long capMs = 32000)
+        : MqttBackoff(baseMs, capMs), previous(baseMs) {}
+
+    void reset() override { previous = base; }
+    unsigned long firstDelay() override { return random(0, base); }
+    unsigned long nextDelay() override {
+        unsigned long delay = random(base, previous * 3);
+        previous = delay < cap ? delay : cap;
+        return previous;
+    }
+
+private:
+    unsigned long previous; // Last delay returned
+};
+
+#endif // MQTTBACKOFF_H
@@ -0,0 +1,74 @@
+#ifndef MQTTBUFFERPOOL_H
+#define MQTTBUFFERPOOL_H
+
+#include <stddef.h>
+#include <atomic>
+
+/*
+ * Fixed pool of Count preallocated blocks of type Block.
+ *
+ * acquire() hands out a free block and release() returns it; nothing is ever
+ * allocated after construction. Each block has its own atomic in-use flag, so
+ * one task may acquire while another releases (e.g. the network task filling
+ * a buffer that loop() hands back later) without a lock. A Count of 0 gives
+ * an empty pool that takes no RAM.
+ */
+template <typename Block, size_t Count>
+class MqttBufferPool {
+    static_assert(Count > 0, "MqttBufferPool needs at least one block");
+
+public:
+    MqttBufferPool() {
+        for (size_t i = 0; i < Count; i++) {
+            used[i].store(false, std::memory_order_relaxed);
+        }
+    }
+
+    // A free block, or nullptr when all are in use
+    Block *acquire() {
+        for (size_t i = 0; i < Count; i++) {
+            bool expected = false;
+            if (!used[i].load(std::memory_order_relaxed) &&
+                used[i].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return &blocks[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void release(Block *block) {
+        used[block - blocks].store(false, std::memory_order_release);
+    }
+
+    // Whether block is one of this pool's blocks
+    bool owns(const Block *block) const {
+        return block >= blocks && block < blocks + Count;
+    }
+
+    size_t available() const {
+        size_t count = 0;
+        for (size_t i = 0; i < Count; i++) {
+            count += used[i].load(std::memory_order_relaxed) ? 0 : 1;
+        }
+        return count;
+    }
+
+private:
+    Block blocks[Count];
+    std::atomic<bool> used[Count];
+};
+
+// A pool sized 0: the feature it backs is compiled out and acquire() always fails
+template <typename Block>
+class MqttBufferPool<Block, 0> {
+public:
+    Block *acquire() { return nullptr; }
+    void release(Block *block) { (void)block; }
+    bool owns(const Block *block) const {
+        (void)block;
+        return false;
+    }
+    size_t available() const { return 0; }
+};
+
+#endif // MQTTBUFFERPOOL_H
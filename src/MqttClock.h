@@ -0,0 +1,39 @@
+#ifndef MQTTCLOCK_H
+#define MQTTCLOCK_H
+
+#include <Arduino.h>
+
+/*
+ * Time source used by MqttManager for every timing decision (reconnect
+ * backoff and anything else that reads the time).
+ *
+ * The default ArduinoClock reads millis(). Simulations and tests install a
+ * ManualClock with MqttManager::setClock() and advance it explicitly, so hours
+ * of reconnect behavior can be replayed deterministically in milliseconds.
+ */
+class MqttClock {
+public:
+    virtual ~MqttClock() {}
+    virtual unsigned long millis() = 0; // Milliseconds on a monotonic, wrapping 32-bit scale like ::millis()
+};
+
+// Wall-clock time from the Arduino core
+class ArduinoClock : public MqttClock {
+public:
+    unsigned long millis() override { return ::millis(); }
+};
+
+// Time that only moves when told to
+class ManualClock : public MqttClock {
+public:
+    explicit ManualClock(unsigned long start = 0) : now(start) {}
+
+    unsigned long millis() override { return now; }
+    void advance(unsigned long ms) { now += ms; }
+    void set(unsigned long ms) { now = ms; }
+
+private:
+    unsigned long now;
+};
+
+#endif // MQTTCLOCK_H
@@ -0,0 +1,140 @@
+#ifndef MQTTINFLIGHT_H
+#define MQTTINFLIGHT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MqttMessage.h"
+
+/*
+ * QoS 1/2 messages that were handed to the client but not yet acknowledged,
+ * keyed by packet ID.
+ *
+ * Entries live in a fixed open-addressed table (packet ID modulo Capacity,
+ * linear probing), so lookups on PUBACK are O(1) in practice and no memory is
+ * allocated. Each entry keeps a copy of the message when it fits, so messages
+ * still unacknowledged when the connection drops can be queued again; the
+ * options and id are always kept so the sender can be told how it ended.
+ * setWindow() caps how many messages may be in flight at once.
+ */
+template <size_t Capacity, size_t MaxTopicLen, size_t MaxPayloadLen>
+class MqttInflight {
+    static_assert(Capacity > 0, "MqttInflight needs at least one slot");
+
+public:
+    typedef MqttStoredMessage<MaxTopicLen, MaxPayloadLen> Message;
+
+    struct Entry {
+        uint16_t packetId;     // 0 marks a free slot
+        unsigned long sentAt;  // Clock time of the publish
+        unsigned long sequence; // Send order, to requeue oldest first
+        bool stored;           // message holds a copy that can be sent again
+        Message message;       // options and id are always set
+    };
+
+    MqttInflight() : count(0), window(Capacity), nextSequence(0), acked(0) {
+        for (size_t i = 0; i < Capacity; i++) {
+            entries[i].packetId = 0;
+        }
+    }
+
+    // Maximum unacknowledged messages (clamped to 1..Capacity)
+    void setWindow(size_t newWindow) {
+        window = newWindow == 0 ? 1 : (newWindow < Capacity ? newWindow : Capacity);
+    }
+
+    bool full() const { return count >= window; }
+    size_t size() const { return count; }
+    unsigned long ackedCount() const { return acked; }
+
+    // Track a published message; keeps a copy when it fits. Returns nullptr when the table is full.
+    Entry *add(uint16_t packetId, unsigned long now, const char *topic, const char *payload, size_t length,
+               const MqttPublishOptions &options, uint32_t id) {
+        if (packetId == 0 || count >= Capacity) {
+            return nullptr;
+        }
+        size_t index = packetId % Capacity;
+        while (entries[index].packetId != 0) {
+            index = (index + 1) % Capacity;
+        }
+        Entry &entry = entries[index];
+        entry.packetId = packetId;
+        entry.sentAt = now;
+        entry.sequence = nextSequence++;
+        entry.stored = Message::fits(topic, length);
+        if (entry.stored) {
+            entry.message.assign(topic, payload, length, options, id);
+        } else {
+            entry.message.options = options;
+            entry.message.id = id;
+        }
+        count++;
+        return &entry;
+    }
+
+    Entry *find(uint16_t packetId) {
+        if (packetId == 0) {
+            return nullptr;
+        }
+        size_t index = packetId % Capacity;
+        for (size_t probes = 0; probes < Capacity; probes++) {
+            if (entries[index].packetId == packetId) {
+                return &entries[index];
+            }
+            index = (index + 1) % Capacity;
+        }
+        return nullptr;
+    }
+
+    // Forget an entry after its acknowledgement (or after requeueing it)
+    void release(Entry *entry, bool wasAcked) {
+        entry->packetId = 0;
+        count--;
+        if (wasAcked) {
+            acked++;
+        }
+        // Re-seat followers of the probe chain so find() keeps working without tombstones
+        size_t index = (entry - entries + 1) % Capacity;
+        while (entries[index].packetId != 0) {
+            Entry moved = entries[index];
+            entries[index].packetId = 0;
+            count--;
+            size_t target = moved.packetId % Capacity;
+            while (entries[target].packetId != 0) {
+                target = (target + 1) % Capacity;
+            }
+            entries[target] = moved;
+            count++;
+            index = (index + 1) % Capacity;
+        }
+    }
+
+    // An entry sent at least timeout ms before now, or nullptr
+    Entry *expired(unsigned long now, unsigned long timeout) {
+        for (size_t i = 0; i < Capacity; i++) {
+            if (entries[i].packetId != 0 && now - entries[i].sentAt >= timeout) {
+                return &entries[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // Most recently sent entry, or nullptr when empty
+    Entry *newest() {
+        Entry *result = nullptr;
+        for (size_t i = 0; i < Capacity; i++) {
+            if (entries[i].packetId != 0 && (!result || entries[i].sequence > result->sequence)) {
+                result = &entries[i];
+            }
+        }
+        return result;
+    }
+
+private:
+    Entry entries[Capacity];
+    size_t count;
+    size_t window;
+    unsigned long nextSequence;
+    unsigned long acked;
+};
+
+#endif // MQTTINFLIGHT_H
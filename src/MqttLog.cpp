@@ -0,0 +1,126 @@
+#include "MqttLog.h"
+#include <stdarg.h>
+#include <stdio.h>
+#if defined(MQTTMANAGER_LOG_DEFERRED) && defined(ARDUINO_HOST_SHIM)
+#include <mutex>
+#endif
+
+#ifdef MQTTMANAGER_LOG_DEFERRED
+namespace {
+
+// Byte ring shared by every task that logs. Writers copy a whole line in a
+// short critical section; the single reader (mqttLogDrain) copies out chunks in
+// the same critical section and does the slow Serial write after leaving it.
+char logBuffer[MQTTMANAGER_LOG_BUFFER_SIZE];
+size_t logHead = 0;  // Next byte to drain
+size_t logCount = 0; // Bytes waiting to be drained
+unsigned long logDropped = 0;
+
+// Never a plain spin lock: on FreeRTOS a higher-priority task spinning on it
+// would starve a lower-priority holder on the same core until the watchdog
+// fires. The ESP32 critical section keeps the holder from being preempted and
+// guards against the other core; single-core boards mask interrupts.
+#if defined(ARDUINO_ARCH_ESP32)
+portMUX_TYPE logMux = portMUX_INITIALIZER_UNLOCKED;
+
+void lock() {
+    portENTER_CRITICAL(&logMux);
+}
+
+void unlock() {
+    portEXIT_CRITICAL(&logMux);
+}
+#elif defined(ARDUINO_HOST_SHIM)
+std::mutex logMutex;
+
+void lock() {
+    logMutex.lock();
+}
+
+void unlock() {
+    logMutex.unlock();
+}
+#else
+void lock() {
+    noInterrupts();
+}
+
+void unlock() {
+    interrupts();
+}
+#endif
+
+} // namespace
+#endif
+
+// Format one line and emit it (directly or deferred)
+void mqttLogWrite(const char *format, ...) {
+    char line[MQTTMANAGER_LOG_LINE_LEN];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length > sizeof(line) - 2) {
+        length = sizeof(line) - 2; // Truncated by vsnprintf
+    }
+
+#ifdef MQTTMANAGER_LOG_DEFERRED
+    line[length++] = '\n';
+    lock();
+    if (logCount + length > sizeof(logBuffer)) {
+        logDropped++; // Never split a line; drop it whole
+    } else {
+        size_t tail = (logHead + logCount) % sizeof(logBuffer);
+        for (int i = 0; i < length; i++) {
+            logBuffer[(tail + i) % sizeof(logBuffer)] = line[i];
+        }
+        logCount += length;
+    }
+    unlock();
+#else
+    line[length] = '\0';
+    Serial.println(line);
+#endif
+}
+
+// Write up to maxBytes of buffered log output to Serial; returns the number of bytes written
+size_t mqttLogDrain(size_t maxBytes) {
+#ifdef MQTTMANAGER_LOG_DEFERRED
+    size_t written = 0;
+    char chunk[64];
+    while (written < maxBytes) {
+        size_t length = 0;
+        lock();
+        while (length < sizeof(chunk) && logCount && written + length < maxBytes) {
+            chunk[length++] = logBuffer[logHead];
+            logHead = (logHead + 1) % sizeof(logBuffer);
+            logCount--;
+        }
+        unlock();
+        if (length == 0) {
+            break;
+        }
+        Serial.write((const uint8_t *)chunk, length);
+        written += length;
+    }
+    return written;
+#else
+    (void)maxBytes;
+    return 0; // Lines were already written directly
+#endif
+}
+
+// Deferred lines lost because the buffer was full
+unsigned long mqttLogDropped() {
+#ifdef MQTTMANAGER_LOG_DEFERRED
+    lock();
+    unsigned long dropped = logDropped;
+    unlock();
+    return dropped;
+#else
+    return 0;
+#endif
+}
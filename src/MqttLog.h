@@ -0,0 +1,67 @@
+#ifndef MQTTLOG_H
+#define MQTTLOG_H
+
+#include <Arduino.h>
+
+/*
+ * Compile-time logging for MqttManager.
+ *
+ * Every log statement in the library goes through the MQTT_LOG* macros below.
+ * Statements above MQTTMANAGER_LOG_LEVEL expand to nothing, so their arguments
+ * are not even evaluated and release builds carry no Serial calls at all:
+ *
+ *     build_flags = -DMQTTMANAGER_LOG_LEVEL=MQTTMANAGER_LOG_NONE
+ *
+ * Defining MQTTMANAGER_LOG_DEFERRED routes the enabled statements into a RAM
+ * ring buffer instead of writing to Serial directly. Formatting still happens
+ * in the caller, but the slow UART write is postponed until mqttLogDrain() is
+ * called from loop().
+ */
+
+#define MQTTMANAGER_LOG_NONE 0  // No output
+#define MQTTMANAGER_LOG_ERROR 1 // Failures that lose data
+#define MQTTMANAGER_LOG_WARN 2  // Recoverable problems
+#define MQTTMANAGER_LOG_INFO 3  // Connection state changes
+#define MQTTMANAGER_LOG_DEBUG 4 // Per-message tracing
+
+#ifndef MQTTMANAGER_LOG_LEVEL
+#define MQTTMANAGER_LOG_LEVEL MQTTMANAGER_LOG_INFO
+#endif
+
+#ifndef MQTTMANAGER_LOG_BUFFER_SIZE
+#define MQTTMANAGER_LOG_BUFFER_SIZE 1024 // Bytes of RAM used by the deferred logger
+#endif
+
+#ifndef MQTTMANAGER_LOG_LINE_LEN
+#define MQTTMANAGER_LOG_LINE_LEN 128 // Longest formatted line; longer lines are truncated
+#endif
+
+void mqttLogWrite(const char *format, ...); // Format one line and emit it (directly or deferred)
+size_t mqttLogDrain(size_t maxBytes = MQTTMANAGER_LOG_BUFFER_SIZE); // Write buffered lines to Serial
+unsigned long mqttLogDropped(); // Deferred lines lost because the buffer was full
+
+#if MQTTMANAGER_LOG_LEVEL >= MQTTMANAGER_LOG_ERROR
+#define MQTT_LOGE(...) mqttLogWrite(__VA_ARGS__)
+#else
+#define MQTT_LOGE(...) do {} while (0)
+#endif
+
+#if MQTTMANAGER_LOG_LEVEL >= MQTTMANAGER_LOG_WARN
+#define MQTT_LOGW(...) mqttLogWrite(__VA_ARGS__)
+#else
+#define MQTT_LOGW(...) do {} while (0)
+#endif
+
+#if MQTTMANAGER_LOG_LEVEL >= MQTTMANAGER_LOG_INFO
+#define MQTT_LOGI(...) mqttLogWrite(__VA_ARGS__)
+#else
+#define MQTT_LOGI(...) do {} while (0)
+#endif
+
+#if MQTTMANAGER_LOG_LEVEL >= MQTTMANAGER_LOG_DEBUG
+#define MQTT_LOGD(...) mqttLogWrite(__VA_ARGS__)
+#else
+#define MQTT_LOGD(...) do {} while (0)
+#endif
+
+#endif // MQTTLOG_H
@@ -1,5 +1,4 @@
 #include "MqttManager.h"
-#include <AsyncMqttClient.h>
 /*
  * MqttManager Usage Example
  * ===========================
@@ -54,6 +53,18 @@
  *       - `server`: The IP address or hostname of the MQTT server.
  *       - `port`: The port on which the MQTT server is listening (usually 1883).
  *
+ * - `addServer(const char *server, int port, uint8_t priority = 0)`
+ *   - Adds a broker to fail over to (up to MQTTMANAGER_MAX_SERVERS). `setServer()` replaces the
+ *     list with a single broker. Lower priority values are preferred.
+ *
+ * - `setDnsCacheTtl(unsigned long ttlMs, unsigned long staleMs)` / `setResolver(MqttResolver *resolver)`
+ *   - How long a resolved broker address is used (default 5 min fresh plus 1 h stale), and the
+ *     asynchronous lookup used for host names (default: lwIP's DNS client on the ESP32).
+ *
+ * - `setFailbackInterval(unsigned long intervalMs)`
+ *   - While connected to a backup, how often to check whether a preferred broker may be retried
+ *     (default 60 s, 0 = stay on the backup until it fails).
+ *
  * - `setLwt(const char *topic)`
  *   - Sets the Last Will and Testament (LWT) topic for the MQTT client.
  *   - This message is sent if the client unexpectedly disconnects from the broker.
@@ -71,10 +82,93 @@
  *
  * - `sendMessage(const char *topic, const char *message)`
  *   - Sends a message to a specified MQTT topic.
+ *   - While disconnected the message is stored in the outbox and sent after reconnecting.
  *   - Parameters:
  *       - `topic`: The MQTT topic where the message will be published.
  *       - `message`: The message content to be sent.
  *
+ * - `sendMessage(const char *topic, const uint8_t *data, size_t length)`
+ *   - Sends a binary payload of exactly `length` bytes; the data may contain NUL bytes and is
+ *     passed to the client without encoding. With C++17, `sendMessage(topic, std::string_view)`
+ *     does the same for any contiguous byte buffer.
+ *
+ * - `subscribe(const char *filter, uint8_t qos, MqttMessageHandler handler, void *context = nullptr)`
+ *   - Calls `handler(message, context)` for every received message whose topic matches `filter`
+ *     (`+` and `#` wildcards allowed). Several handlers may share a filter; the broker is
+ *     subscribed once, with the highest QoS requested.
+ *   - `unsubscribe(filter)` removes all handlers of that filter.
+ *   - `setMaxInboundLength(size_t length)` lowers the largest payload handed to handlers;
+ *     `inboundDropped()` counts messages that were too large or could not be reassembled.
+ *
+ * - `queueMessage(...)`
+ *   - Same overloads as `sendMessage()`, but safe to call from any FreeRTOS task or core: the message
+ *     is copied into a lock-free queue and published by the next `poll()`. Returns a handle with
+ *     status QUEUED, or DROPPED when the queue is full or the message does not fit.
+ *   - `queueDropped()` counts refused calls.
+ *
+ * - `leasePayload(size_t capacity)`
+ *   - Returns an `MqttPayloadLease`: a buffer of at least `capacity` bytes from the manager's
+ *     payload pool, to be filled in place and moved into `sendMessage(topic, std::move(lease))` or
+ *     `queueMessage(topic, std::move(lease))`. The lease is empty when no buffer is free;
+ *     `payloadPoolExhausted()` counts those calls.
+ *
+ * - `sendMessage(topic, std::unique_ptr<uint8_t[]> data, size_t length)` / `queueMessage(...)`
+ *   - Take over a heap buffer instead of borrowing it; see Payload Ownership.
+ *
+ * - `startPublisherTask(int core, unsigned priority, size_t stackSize = 4096)` / `stopPublisherTask()`
+ *   - Runs `poll()` and `reconnect()` on a task of the manager's own, pinned to `core`. Other tasks'
+ *     `sendMessage()` calls are queued for it; `setPublisherBatch()` sets how many it publishes
+ *     before yielding.
+ *
+ * - `setDeferredDispatch(bool deferred)` / `poll()`
+ *   - With deferred dispatch on (set it before `connect()`), connection events, acknowledgements and
+ *     received messages are queued by the network task and handled by `poll()`, called from `loop()`.
+ *   - `eventsDropped()` counts events lost because the queue was full.
+ *
+ * - `setOutboxCapacity(size_t capacity)` / `setOutboxDropPolicy(MqttDropPolicy policy)`
+ *   - Limit how many messages are kept while offline (up to MQTTMANAGER_OUTBOX_SIZE, 0 disables it).
+ *   - Choose whether a full outbox discards the oldest (`DROP_OLDEST`, default) or the
+ *     incoming message (`DROP_NEWEST`).
+ *
+ * - `setPrioritySchedule(MqttPrioritySchedule schedule, urgentWeight, normalWeight, bulkWeight)`
+ *   - `MqttPublishOptions::priority` (URGENT, NORMAL or BULK) picks the outbox lane a message
+ *     waits in; STRICT (default) or WEIGHTED sets how the lanes are drained. See Priority Lanes.
+ *
+ * - `setLatestOnly(const char *topic)`
+ *   - Keeps at most one queued message of a state topic: a newer one replaces it in place.
+ *     `outboxReplaced()` counts the replaced messages.
+ *
+ * - `sendMessage(topic, message, MqttPublishOptions(qos, retain))` (and the binary overloads)
+ *   - Publishes with an explicit QoS (0, 1 or 2) and retain flag.
+ *   - `setDefaultPublishOptions()` and `setTopicOptions(topic, options)` set what the overloads
+ *     without options use; the default stays QoS 0, retained.
+ *
+ * - `beginBatch()` / `endBatch()` / `setBatchWindow(unsigned long maxDelayMs)` / `flushBatch()`
+ *   - Collect QoS 0 messages and write them to the connection together; see Batched Publishing.
+ *     `batchWrites()` counts batches written in a single write.
+ *
+ * - `setRateLimit(unsigned long messagesPerSecond, unsigned long burst, MqttRateLimitPolicy policy)`
+ *   - Token-bucket limit on all publishes; `setTopicRateLimit(topic, ...)` limits one topic on top
+ *     of it. See Rate Limiting. `rateLimitStats()` counts queued, coalesced and dropped messages.
+ *
+ * - `registerTopic(const char *pattern)` / `setTopicVariable(const char *name, const char *value)`
+ *   - Declares a topic once and returns a two-byte `MqttTopic` handle that every `sendMessage()` and
+ *     `queueMessage()` overload with a text or binary payload also accepts. `{name}` placeholders
+ *     in the pattern are replaced by the values set before. `topicName(handle)` returns the topic.
+ *
+ * - Every `sendMessage()` overload returns an `MqttPublishHandle` (id, packet ID, status):
+ *   SENT, QUEUED, IN_FLIGHT or DROPPED when the call returns. `MqttPublishOptions` can carry a
+ *   completion callback and context pointer, called once with the final status: SENT (QoS 0),
+ *   ACKNOWLEDGED (QoS 1/2), DROPPED or TIMED_OUT.
+ *
+ * - `setAckTimeout(unsigned long timeoutMs)`
+ *   - How long to wait for a QoS 1/2 acknowledgement (default 30 s, 0 = forever). Checked by
+ *     `reconnect()`; overdue messages complete as TIMED_OUT and free their window slot.
+ *
+ * - `setInflightWindow(size_t window)` / `inflightCount()` / `acknowledgedCount()`
+ *   - How many QoS 1/2 messages may be sent before their acknowledgements arrive (up to
+ *     MQTTMANAGER_INFLIGHT_SIZE, 1 by default), and how many are waiting or were acknowledged.
+ *
  * Callback Functions:
  * -------------------
  *
@@ -95,103 +189,250 @@
  *
  * This ensures the ESP32 does not overwhelm the broker with frequent connection attempts.
  *
+ * The delays come from an `MqttBackoff` policy. The default `ExponentialBackoff` keeps the
+ * behavior above. For fleets, `setBackoff(&policy)` installs `FullJitterBackoff` or
+ * `DecorrelatedJitterBackoff` (both take a base and a cap); they randomize every delay,
+ * including the wait before the first retry after a connection loss, so devices dropped by
+ * the same broker restart do not reconnect in lock-step. The random sequence is seeded from
+ * the client ID (`setClientId()`).
+ *
+ * Broker Failover:
+ * ----------------
+ * Each broker keeps a health record: consecutive failed attempts, a smoothed connect time and a
+ * smoothed round-trip time measured from QoS 1/2 publish to acknowledgement. `connect()` picks the
+ * healthy broker with the best priority and, among equals, the lowest latency. A failed attempt
+ * quarantines that broker for 5 s, doubling with each further failure up to 5 minutes, so the
+ * next attempt goes to a backup. While on a backup, `reconnect()` drops the connection every
+ * failback interval if a preferred broker has left quarantine, so it is retried and used again
+ * once it is back.
+ *
+ * Host Names and DNS Cache:
+ * -------------------------
+ * Brokers may be given by name (up to MQTTMANAGER_MAX_HOST_LEN - 1 characters). The name is
+ * resolved on the first connect and the address cached with the server. Lookups never block:
+ * `MqttResolver::begin()` starts one (on the ESP32 through `tcpip_callback()` and lwIP's
+ * `dns_gethostbyname()`, on the host on a thread of its own) and `reconnect()`/`poll()` collect
+ * the answer on the publishing task, so neither `loop()` nor the network task waits for a DNS
+ * server. The first connect happens once the answer is in. Within the TTL the cached address is
+ * used as is. After it, a lookup refreshes it in the background while the connection is up. If
+ * the device was offline, the stale address is still used for up to `staleMs` more. When it is
+ * older still, or connecting to it failed, it is looked up again and the old address keeps being
+ * used until the answer arrives. A failed lookup keeps the old address. IP literals are never
+ * looked up. Other cores have no default resolver, so names there need `setResolver()`. Neither
+ * lwIP nor getaddrinfo() report record TTLs, so the TTL is configured rather than taken from DNS.
+ *
+ * Subscriptions:
+ * --------------
+ * Filters live in a topic trie built from fixed pools (MQTTMANAGER_MAX_TOPIC_NODES levels,
+ * MQTTMANAGER_MAX_SUBSCRIPTIONS handlers), so dispatching a message costs one walk over its topic
+ * levels however many filters are registered. Filters added while offline are subscribed on
+ * connect, and every filter is subscribed again when the broker reports no stored session. Without
+ * deferred dispatch, a message that arrives in one piece walks the trie on the AsyncTCP task while
+ * `loop()` may be changing it, so subscribing or unsubscribing after `connect()` requires
+ * `setDeferredDispatch(true)`; with the publisher task, subscribe before starting it.
+ *
+ * Inbound Reassembly:
+ * -------------------
+ * AsyncMqttClient hands large payloads over one TCP segment at a time. A message that arrives in
+ * one piece is dispatched straight from the client's buffer; a chunked one is copied into a buffer
+ * from a fixed pool (MQTTMANAGER_REASSEMBLY_BUFFERS of MQTTMANAGER_MAX_INBOUND_LEN bytes, 1 x
+ * 1024) and dispatched once complete, so handlers always see the whole payload and nothing is
+ * allocated per message. Messages over the limit, without a free buffer, or cut short by a
+ * disconnect are dropped and counted.
+ *
+ * Deferred Dispatch:
+ * ------------------
+ * Connection events and acknowledgements change the outbox and the in-flight table, which
+ * `sendMessage()` uses on the application's task, so they always go through a lock-free
+ * single-producer/single-consumer ring (MQTTMANAGER_EVENT_QUEUE_SIZE entries): the client's
+ * onConnect, onDisconnect and onPublish callbacks only copy the event in and return, and the next
+ * `reconnect()`, `sendMessage()` or `poll()` on the application's task publishes the online
+ * message, drains the outbox, frees the acknowledged in-flight entry or schedules the reconnect.
+ * Received messages take the ring only with `setDeferredDispatch(true)`; by default their handlers
+ * run on the AsyncTCP task, which holds up the network stack. Deferred, every received message
+ * takes a pool buffer until `poll()` dispatches it from `loop()`, so handlers and manager state
+ * are only touched by that task. Messages and acknowledgements leave the last few slots to
+ * connection events; anything that does not fit is dropped and counted.
+ *
+ * Publishing From Several Tasks:
+ * ------------------------------
+ * `sendMessage()` writes to the client directly and is not thread-safe. `queueMessage()` is: it
+ * claims a slot of a bounded lock-free multi-producer/single-consumer queue
+ * (MQTTMANAGER_PUBLISH_QUEUE_SIZE messages, 2 unless raised, of up to MQTTMANAGER_MAX_PAYLOAD_LEN
+ * bytes) with one compare-and-swap and copies the message in, never blocking. `poll()` is the
+ * single drain point: it feeds the queued messages, oldest first, through the same path as
+ * `sendMessage()`, so every client write happens on the task that calls `poll()`. Completion
+ * callbacks of queued messages run there too, except for DROPPED, which is reported to the caller
+ * right away. Configure per-topic options during setup: queueMessage() reads them from the calling
+ * task.
+ *
+ * Publisher Task:
+ * ---------------
+ * `startPublisherTask()` creates a task (FreeRTOS, pinned with xTaskCreatePinnedToCore(); a
+ * std::thread with CPU affinity on the host) that owns all client work: it handles the deferred
+ * client events, publishes queued messages in batches of `setPublisherBatch()` (8) with a yield in
+ * between, and runs the reconnect/timeout logic. It sleeps on a task notification that queued
+ * messages and client events raise, waking at least every 50 ms for the timers. While it runs,
+ * `sendMessage()` from any other task takes the `queueMessage()` path, and `connect()`, `reconnect()`
+ * and `poll()` called elsewhere return at once, so the application core never waits on the TCP
+ * stack. Start it after `connect()`. The task reads the subscriptions, rate limits and outbox
+ * settings without a lock, so `subscribe()`, `unsubscribe()`, the rate limit setters, the outbox
+ * setters and `setLatestOnly()` are refused with a logged error while it runs; configure them
+ * before starting it. On cores without FreeRTOS it returns false and `loop()` keeps calling
+ * `poll()` and `reconnect()`.
+ *
+ * Batched Publishing:
+ * -------------------
+ * Every publish() is normally its own TCP segment and radio frame. Between `beginBatch()` and
+ * `endBatch()`, or while `setBatchWindow()` is non-zero, QoS 0 messages that would be published
+ * right away are encoded as PUBLISH packets into one buffer of MQTTMANAGER_BATCH_BYTES (1460 fills
+ * one TCP segment) for up to MQTTMANAGER_BATCH_MESSAGES messages. Both default to 0, which turns
+ * batching off. The batch is written when it is full, at `endBatch()`/`flushBatch()`, or once its
+ * oldest message has waited the window (checked by `sendMessage()`, `poll()`, `reconnect()` and
+ * the publisher task). Their handles say QUEUED and the completion callback reports SENT when the
+ * batch is written. Any message that is not batched (QoS 1/2, too large, or bound for the outbox)
+ * writes the batch first, so the order is kept; a batch that cannot be written goes to the outbox.
+ * The batch is a single write only when the library is built with MQTTMANAGER_BATCH_RAW_WRITE, for
+ * a client that has `writeRaw()` (the host shim). The Arduino AsyncMqttClient has no such call:
+ * there the batch is published message by message when it is flushed, which saves nothing and only
+ * delays the messages.
+ *
+ * Rate Limiting:
+ * --------------
+ * A token bucket refills at the configured rate up to the burst size and every publish takes a
+ * token from the global bucket and from its topic's, if it has one. Tokens are checked where a
+ * message would go out: sendMessage() while connected, the batch and the outbox drain. A message
+ * that finds a bucket empty follows that bucket's policy: QUEUE puts it in the outbox, COALESCE
+ * overwrites the newest queued message of the same topic in place (reporting the old one DROPPED)
+ * or queues it when there is none, and DROP reports it DROPPED. Queued messages go to the lane of
+ * their priority and are released from `poll()`, `reconnect()` and the publisher task as tokens
+ * return: lane by lane as the STRICT or WEIGHTED schedule picks them, oldest first within a lane,
+ * like any other queued message. While the global bucket is empty nothing is released; messages of
+ * a topic waiting for its own tokens are passed over, so other topics are neither held up behind
+ * it nor evicted for it (when the outbox is full it displaces its own oldest message under
+ * DROP_OLDEST and is refused under DROP_NEWEST). Messages queued while offline are limited when
+ * they drain.
+ *
+ * Priority Lanes:
+ * ---------------
+ * The outbox slots are shared by three FIFO lanes, one per MqttPriority, each a linked list of
+ * slot indexes. A message is published right away unless its own lane or a more urgent one has
+ * messages waiting, so an alarm never queues behind BULK telemetry. When it does have to wait
+ * (offline, in-flight window full, rate limit), `drainOutbox()` takes the next message from the
+ * lane the schedule picks: STRICT always serves the most urgent lane, while WEIGHTED gives each
+ * waiting lane as many turns per round as its weight (4:2:1 by default), which bounds an alarm's
+ * wait to a few BULK messages without starving BULK. A full outbox makes room in the least
+ * urgent lane, and never evicts a message for a less urgent one. Messages queued with
+ * `queueMessage()` still pass the publish queue in order; it holds at most
+ * MQTTMANAGER_PUBLISH_QUEUE_SIZE messages.
+ *
+ * Topic Registry:
+ * ---------------
+ * Topics like "korngva/sound_monitor/first_floor/sound_state" are usually rebuilt with snprintf()
+ * for every reading. `registerTopic()` expands the pattern once into a fixed table of
+ * MQTTMANAGER_MAX_TOPICS entries and returns its index as an `MqttTopic` handle. Each entry also
+ * points at its `setTopicOptions()` entry, kept current when options are set later, so publishing
+ * by handle skips the options search; `queueMessage()` stores the handle in the queue instead of
+ * copying the topic. Placeholder values (MQTTMANAGER_MAX_TOPIC_VARIABLES of up to
+ * MQTTMANAGER_MAX_TOPIC_VARIABLE_LEN bytes) only matter at registration. Register topics during
+ * setup; afterwards the table is only read, so handles can be used from any task. An invalid
+ * handle (unknown placeholder, topic too long, table full) makes every publish report DROPPED.
+ *
+ * Payload Pool:
+ * -------------
+ * Payloads built with `String` or on the heap fragment it over weeks of uptime. The manager keeps
+ * fixed buffers in three size classes instead: MQTTMANAGER_PAYLOAD_SMALL_BLOCKS of
+ * MQTTMANAGER_PAYLOAD_SMALL_SIZE (32) bytes, MQTTMANAGER_PAYLOAD_MEDIUM_BLOCKS of
+ * MQTTMANAGER_PAYLOAD_MEDIUM_SIZE (128) bytes and MQTTMANAGER_PAYLOAD_LARGE_BLOCKS of
+ * MQTTMANAGER_MAX_PAYLOAD_LEN bytes. The block counts default to 0, so the pool is empty until
+ * they are raised. `leasePayload()` takes the smallest free block that is large enough, with
+ * atomic flags only, so any task may lease. The lease is move-only: moving it into
+ * `sendMessage()`/`queueMessage()` hands the block back once the message has been handed on, and a
+ * lease that is dropped unsent returns it from its destructor. Publishing an empty lease reports
+ * DROPPED.
+ *
+ * Payload Ownership:
+ * ------------------
+ * `const char *` and `const uint8_t *` payloads are borrowed: they are only read during the call,
+ * so `queueMessage()` copies them into its slot. Payloads passed as `std::unique_ptr<uint8_t[]>`
+ * or as an `MqttPayloadLease` are owned by the manager from the moment of the call, whatever the
+ * outcome. On the direct path their bytes go straight to `AsyncMqttClient::publish()` and the buffer
+ * is freed (or returned to the pool) before `sendMessage()` returns. `queueMessage()`, and
+ * `sendMessage()` while the publisher task runs, move the buffer itself into the publish queue,
+ * copying only the topic; it is published and freed by `poll()` on the polling task, so it may be
+ * larger than a queue slot. A refused message frees its buffer on the calling task. Buffers that
+ * end up in the outbox or the in-flight table are copied there, because those must outlive the
+ * caller's buffer across reconnects.
+ *
+ * Static Configuration:
+ * ---------------------
+ * `MqttManager` is `BasicMqttManager<MQTTMANAGER_MAX_TOPIC_LEN, MQTTMANAGER_MAX_PAYLOAD_LEN,
+ * MQTTMANAGER_OUTBOX_SIZE>`, compiled once in this file. Other instances can pick their own topic
+ * and payload limits and outbox depth as template arguments, and every other size through a
+ * `Limits` struct derived from `MqttManagerLimits`. All buffers (outbox, in-flight table, queues,
+ * reassembly and payload pools, topic trie, server list, LWT topic) are members, so `sizeof()` is the
+ * manager's RAM footprint and nothing is allocated after construction; only AsyncMqttClient's
+ * own buffers are outside it. A non-zero `Limits::ramBudget` makes the constructor fail to compile
+ * when `sizeof()` exceeds it. It defaults to MQTTMANAGER_RAM_BUDGET (16 KB), which the default
+ * `MqttManager` (about 12.5 KB on a 64-bit host, most of it the outbox) fits with room to spare;
+ * raising other limits may need a larger budget. Features that stay idle until called (the
+ * in-flight window, publish queue, batch buffer, payload pool and the per-topic tables) default to
+ * the smallest size that works, or none, so they cost almost nothing unless their limits are
+ * raised. The member definitions live in MqttManagerImpl.h so that such instances can be
+ * compiled where they are used.
+ *
+ * Time Source:
+ * ------------
+ * All timing (reconnect backoff) is read through an `MqttClock`. The default reads `millis()`;
+ * `setClock(&manualClock)` lets a simulator advance time explicitly and replay long
+ * reconnect scenarios deterministically.
+ *
+ * Logging:
+ * --------
+ * Log output is selected at compile time with MQTTMANAGER_LOG_LEVEL (NONE, ERROR, WARN, INFO,
+ * DEBUG; default INFO). Disabled levels compile to nothing, so a build with
+ * -DMQTTMANAGER_LOG_LEVEL=MQTTMANAGER_LOG_NONE has no Serial calls on the publish path.
+ * With -DMQTTMANAGER_LOG_DEFERRED lines are kept in a RAM ring buffer and only written to
+ * Serial when `mqttLogDrain()` is called from `loop()`.
+ *
+ * Offline Outbox:
+ * ---------------
+ * Messages sent while the broker is unreachable are copied into fixed-size slots
+ * (MQTTMANAGER_OUTBOX_SIZE slots of MQTTMANAGER_MAX_TOPIC_LEN + MQTTMANAGER_MAX_PAYLOAD_LEN
+ * bytes, allocated with the MqttManager object) and published right after the online message
+ * once the connection is back. The slots are shared by three lanes, one per MqttPriority. Lanes
+ * are drained as the schedule picks them (STRICT: most urgent first; WEIGHTED: turns in
+ * proportion to the lane weights, see Priority Lanes), and each lane is drained oldest first,
+ * so messages of the same priority keep the order they were sent in. Messages that do not fit a
+ * slot are dropped and counted in `outboxDropped()`.
+ *
+ * For state topics only the current value matters. A topic passed to `setLatestOnly()` gets a key
+ * (its index in a table of MQTTMANAGER_MAX_LATEST_ONLY topics), and the outbox remembers the slot
+ * of each key's queued message. A newer message overwrites that slot, keeping its place in the
+ * queue, and the old one completes as DROPPED, so a long outage leaves one message per state topic
+ * to drain instead of every intermediate value. Finding the key takes one hash of the topic (the
+ * table is open-addressed by FNV-1a), and only for messages that are queued; the replacement
+ * itself is O(1). A newer message with a different priority is queued at the back of its own lane
+ * instead, so it is drained with its new priority; lanes are linked both ways, so that move is
+ * O(1) too.
+ *
+ * QoS and In-Flight Tracking:
+ * ---------------------------
+ * QoS 1/2 publishes are recorded by packet ID in a fixed in-flight table and removed when
+ * `AsyncMqttClient::onPublish` reports the acknowledgement. While the window is full, further
+ * QoS 1/2 messages wait in the outbox and go out as acknowledgements come in. The client drops
+ * unacknowledged messages on disconnect, so they are put back at the front of the outbox and
+ * published again after the reconnect.
+ *
  * Notes:
  * ------
  * - Ensure you are using an MQTT broker that supports the LWT feature for the best results.
  * - The MQTT client operates asynchronously, meaning the program will continue running
  *   even if the connection is lost, as long as `reconnect()` is called periodically.
  *
- * For more advanced MQTT features (like subscribing to topics or handling incoming messages),
- * you can expand the MqttManager class or use the built-in callback functions provided by
- * the `AsyncMqttClient` library.
+ * For MQTT features not covered here, you can expand the MqttManager class or use the built-in
+ * callback functions provided by the `AsyncMqttClient` library.
  */
 
-MqttManager::MqttManager()
-    : mqtt_port(1883), // Default MQTT port
-      reconnectDelay(1000), // Start with 1 second delay
-      lastReconnectAttempt(0) // Start with no reconnect attempts
-{
-    mqttClient.onConnect([this](bool sessionPresent) {
-        onConnect(&mqttClient, sessionPresent); // Call the connection callback
-    });
-
-    mqttClient.onDisconnect([this](AsyncMqttClientDisconnectReason reason) {
-        onDisconnect(&mqttClient, reason); // Call the disconnection callback
-    });
-}
-
-// Set the MQTT server and port
-void MqttManager::setServer(const char *server, int port) {
-    strncpy(mqtt_server, server, sizeof(mqtt_server));
-    mqtt_port = port;
-}
-
-// Set the LWT (Last Will and Testament) topic
-void MqttManager::setLwt(const char* topic) {
-    strncpy(lwt_topic, topic, sizeof(lwt_topic));
-}
-
-// Connect to the MQTT broker
-void MqttManager::connect() {
-    if (!mqttClient.connected()) {
-        Serial.println("Connecting to MQTT server...");
-        mqttClient.setServer(mqtt_server, mqtt_port); // Set server and port
-        mqttClient.setKeepAlive(60); // Set the keep-alive interval (60 seconds)
-        
-        // Set LWT message (offline message)
-        mqttClient.setWill(lwt_topic, 0, true, offline_message); 
-        
-        mqttClient.connect(); // Start the connection
-    }
-}
-
-// Reconnect to the MQTT broker with exponential backoff
-void MqttManager::reconnect() {
-    // Attempt to reconnect if not already connected
-    if (!mqttClient.connected() && millis() - lastReconnectAttempt >= reconnectDelay) {
-        Serial.println("Attempting MQTT reconnect...");
-        connect(); // Try to reconnect
-
-        // Exponential backoff logic
-        lastReconnectAttempt = millis();
-        if (reconnectDelay < maxReconnectDelay) {
-            reconnectDelay *= 2; // Double the delay after each failed attempt
-        }
-    }
-}
-
-// Handle connection success
-void MqttManager::onConnect(AsyncMqttClient* client, bool sessionPresent) {
-    Serial.println("Connected to MQTT broker");
-
-    // Send online message when successfully connected
-    sendMessage(lwt_topic, online_message); 
-
-    reconnectDelay = 1000; // Reset the backoff delay to 1 second
-}
-
-
-// Handle disconnection
-void MqttManager::onDisconnect(AsyncMqttClient* client, AsyncMqttClientDisconnectReason reason) {
-    Serial.println("Disconnected from MQTT broker");
-    reconnect(); // Start reconnect process
-}
-
-// Send a message to a specific MQTT topic
-void MqttManager::sendMessage(const char *topic, const char *message) {
-    if (mqttClient.connected()) {
-        mqttClient.publish(topic, 0, true, message); // Publish the message
-        Serial.print("MQTT message sent: ");
-        Serial.print(topic);
-        Serial.print(" -> ");
-        Serial.println(message);
-    } else {
-        Serial.println("MQTT not connected!");
-        reconnect(); // Try to reconnect if disconnected
-    }
-}
-
-// This method returns whether the MQTT client is connected
-bool MqttManager::isConnected() {
-    return mqttClient.connected(); // Return the connection status of the MQTT client
-}
\ No newline at end of file
+// Compile the default manager once; other instantiations are compiled where they are used
+template class BasicMqttManager<MQTTMANAGER_MAX_TOPIC_LEN, MQTTMANAGER_MAX_PAYLOAD_LEN, MQTTMANAGER_OUTBOX_SIZE>;
@@ -3,29 +3,422 @@
 
 #include <Arduino.h>
 #include <AsyncMqttClient.h>
+#include "MqttBackoff.h"
+#include "MqttBufferPool.h"
+#include "MqttClock.h"
+#include "MqttInflight.h"
+#include "MqttMessage.h"
+#include "MqttMpscQueue.h"
+#include "MqttOutbox.h"
+#include "MqttOwnedPayload.h"
+#include "MqttPayloadPool.h"
+#include "MqttPublishBatch.h"
+#include "MqttRateLimiter.h"
+#include "MqttResolver.h"
+#include "MqttServerList.h"
+#include "MqttSpscQueue.h"
+#include "MqttTask.h"
+#include "MqttTopicRegistry.h"
+#include "MqttTopicTrie.h"
+#include <atomic>
+#include <utility>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+// Compile-time sizing of the offline outbox; override with -D build flags.
+// Features that stay unused until called (QoS 1/2 windows, queueMessage(),
+// batching, leased payloads, per-topic tables) get the smallest size that
+// works, or none; raise their limits to use them at scale.
+#ifndef MQTTMANAGER_OUTBOX_SIZE
+#define MQTTMANAGER_OUTBOX_SIZE 16 // Number of messages kept while disconnected
+#endif
+#ifndef MQTTMANAGER_MAX_TOPIC_LEN
+#define MQTTMANAGER_MAX_TOPIC_LEN 64 // Longest queued topic, including the terminator
+#endif
+#ifndef MQTTMANAGER_MAX_PAYLOAD_LEN
+#define MQTTMANAGER_MAX_PAYLOAD_LEN 256 // Longest queued payload in bytes
+#endif
+#ifndef MQTTMANAGER_INFLIGHT_SIZE
+#define MQTTMANAGER_INFLIGHT_SIZE 1 // Most QoS 1/2 messages awaiting acknowledgement (raise for QoS 1/2 throughput)
+#endif
+#ifndef MQTTMANAGER_MAX_HOST_LEN
+#define MQTTMANAGER_MAX_HOST_LEN 64 // Longest broker host name, including the terminator
+#endif
+#ifndef MQTTMANAGER_MAX_SERVERS
+#define MQTTMANAGER_MAX_SERVERS 4 // Brokers in the failover list
+#endif
+#ifndef MQTTMANAGER_MAX_SUBSCRIPTIONS
+#define MQTTMANAGER_MAX_SUBSCRIPTIONS 16 // Message handlers registered with subscribe()
+#endif
+#ifndef MQTTMANAGER_MAX_TOPIC_NODES
+#define MQTTMANAGER_MAX_TOPIC_NODES 32 // Distinct topic levels across all subscribed filters
+#endif
+#ifndef MQTTMANAGER_MAX_TOPIC_LEVEL_LEN
+#define MQTTMANAGER_MAX_TOPIC_LEVEL_LEN 24 // Longest level of a subscribed filter, including the terminator
+#endif
+#ifndef MQTTMANAGER_REASSEMBLY_BUFFERS
+#define MQTTMANAGER_REASSEMBLY_BUFFERS 1 // Pooled buffers for inbound messages delivered in chunks or deferred
+#endif
+#ifndef MQTTMANAGER_MAX_INBOUND_LEN
+#define MQTTMANAGER_MAX_INBOUND_LEN 1024 // Largest inbound payload delivered
+#endif
+#ifndef MQTTMANAGER_EVENT_QUEUE_SIZE
+#define MQTTMANAGER_EVENT_QUEUE_SIZE 32 // Client events waiting for poll() in deferred mode (power of two)
+#endif
+#ifndef MQTTMANAGER_PUBLISH_QUEUE_SIZE
+#define MQTTMANAGER_PUBLISH_QUEUE_SIZE 2 // Messages queued by queueMessage() until poll() (power of two, at least 2)
+#endif
+#ifndef MQTTMANAGER_MAX_TOPIC_OPTIONS
+#define MQTTMANAGER_MAX_TOPIC_OPTIONS 1 // Topics with their own default QoS/retain
+#endif
+#ifndef MQTTMANAGER_BATCH_BYTES
+#define MQTTMANAGER_BATCH_BYTES 0 // Encoded QoS 0 packets collected for one write (0 = no batching; 1460 fills a TCP segment)
+#endif
+#ifndef MQTTMANAGER_BATCH_MESSAGES
+#define MQTTMANAGER_BATCH_MESSAGES 0 // Messages collected for one write (0 with MQTTMANAGER_BATCH_BYTES 0)
+#endif
+// Define MQTTMANAGER_BATCH_RAW_WRITE if the AsyncMqttClient in use has
+// bool writeRaw(const uint8_t *data, size_t length) to write a whole batch at
+// once. The host shim has it; the Arduino library does not.
+#ifndef MQTTMANAGER_MAX_TOPICS
+#define MQTTMANAGER_MAX_TOPICS 1 // Topics declared with registerTopic()
+#endif
+#ifndef MQTTMANAGER_MAX_TOPIC_VARIABLES
+#define MQTTMANAGER_MAX_TOPIC_VARIABLES 1 // {name} placeholders set with setTopicVariable()
+#endif
+#ifndef MQTTMANAGER_MAX_TOPIC_VARIABLE_LEN
+#define MQTTMANAGER_MAX_TOPIC_VARIABLE_LEN 32 // Longest placeholder value, including the terminator
+#endif
+#ifndef MQTTMANAGER_MAX_RATE_LIMITS
+#define MQTTMANAGER_MAX_RATE_LIMITS 1 // Topics with their own rate limit
+#endif
+#ifndef MQTTMANAGER_MAX_LATEST_ONLY
+#define MQTTMANAGER_MAX_LATEST_ONLY 1 // Topics whose queued message is replaced by a newer one
+#endif
+#ifndef MQTTMANAGER_PAYLOAD_SMALL_SIZE
+#define MQTTMANAGER_PAYLOAD_SMALL_SIZE 32 // Bytes per small leased payload buffer
+#endif
+#ifndef MQTTMANAGER_PAYLOAD_SMALL_BLOCKS
+#define MQTTMANAGER_PAYLOAD_SMALL_BLOCKS 0 // Small payload buffers in the pool (all three 0: leasePayload() stays empty)
+#endif
+#ifndef MQTTMANAGER_PAYLOAD_MEDIUM_SIZE
+#define MQTTMANAGER_PAYLOAD_MEDIUM_SIZE 128 // Bytes per medium leased payload buffer
+#endif
+#ifndef MQTTMANAGER_PAYLOAD_MEDIUM_BLOCKS
+#define MQTTMANAGER_PAYLOAD_MEDIUM_BLOCKS 0 // Medium payload buffers in the pool
+#endif
+#ifndef MQTTMANAGER_PAYLOAD_LARGE_BLOCKS
+#define MQTTMANAGER_PAYLOAD_LARGE_BLOCKS 0 // Payload buffers of MQTTMANAGER_MAX_PAYLOAD_LEN bytes in the pool
+#endif
+
+#ifndef MQTTMANAGER_RAM_BUDGET
+#define MQTTMANAGER_RAM_BUDGET 16384 // Largest allowed sizeof(MqttManager) in bytes (0 = unchecked)
+#endif
+
+/*
+ * Sizes of BasicMqttManager beyond its topic, payload and queue limits. The defaults come from
+ * the MQTTMANAGER_* build flags; to change some of them for one instance, derive a struct and
+ * redefine those members:
+ *
+ *     struct SmallLimits : MqttManagerLimits {
+ *         static const size_t maxServers = 1;
+ *         static const size_t ramBudget = 8192;
+ *     };
+ *     BasicMqttManager<48, 128, 8, SmallLimits> mqttManager;
+ */
+struct MqttManagerLimits {
+    static const size_t inflightSize = MQTTMANAGER_INFLIGHT_SIZE;
+    static const size_t maxHostLen = MQTTMANAGER_MAX_HOST_LEN;
+    static const size_t maxServers = MQTTMANAGER_MAX_SERVERS;
+    static const size_t maxSubscriptions = MQTTMANAGER_MAX_SUBSCRIPTIONS;
+    static const size_t maxTopicNodes = MQTTMANAGER_MAX_TOPIC_NODES;
+    static const size_t maxTopicLevelLen = MQTTMANAGER_MAX_TOPIC_LEVEL_LEN;
+    static const size_t reassemblyBuffers = MQTTMANAGER_REASSEMBLY_BUFFERS;
+    static const size_t maxInboundLen = MQTTMANAGER_MAX_INBOUND_LEN;
+    static const size_t eventQueueSize = MQTTMANAGER_EVENT_QUEUE_SIZE;
+    static const size_t publishQueueSize = MQTTMANAGER_PUBLISH_QUEUE_SIZE;
+    static const size_t maxTopicOptions = MQTTMANAGER_MAX_TOPIC_OPTIONS;
+    static const size_t batchBytes = MQTTMANAGER_BATCH_BYTES;
+    static const size_t batchMessages = MQTTMANAGER_BATCH_MESSAGES;
+    static const size_t maxTopics = MQTTMANAGER_MAX_TOPICS;
+    static const size_t maxTopicVariables = MQTTMANAGER_MAX_TOPIC_VARIABLES;
+    static const size_t maxTopicVariableLen = MQTTMANAGER_MAX_TOPIC_VARIABLE_LEN;
+    static const size_t maxRateLimits = MQTTMANAGER_MAX_RATE_LIMITS;
+    static const size_t maxLatestOnly = MQTTMANAGER_MAX_LATEST_ONLY;
+    static const size_t payloadSmallSize = MQTTMANAGER_PAYLOAD_SMALL_SIZE;
+    static const size_t payloadSmallBlocks = MQTTMANAGER_PAYLOAD_SMALL_BLOCKS;
+    static const size_t payloadMediumSize = MQTTMANAGER_PAYLOAD_MEDIUM_SIZE;
+    static const size_t payloadMediumBlocks = MQTTMANAGER_PAYLOAD_MEDIUM_BLOCKS;
+    static const size_t payloadLargeBlocks = MQTTMANAGER_PAYLOAD_LARGE_BLOCKS; // Large buffers hold MaxPayloadLen bytes
+    static const size_t ramBudget = MQTTMANAGER_RAM_BUDGET; // sizeof() limit checked at compile time (0 = unchecked)
+};
+
+/*
+ * MQTT connection manager with every buffer sized at compile time.
+ *
+ * MaxTopicLen bounds topics (terminator included), MaxPayloadLen the payloads
+ * kept in the outbox, the in-flight table and the publish queue, QueueDepth
+ * the outbox. Everything else comes from Limits. All storage is inside the
+ * object, so sizeof() is the manager's whole RAM footprint apart from what
+ * AsyncMqttClient allocates itself; nothing is allocated after construction.
+ * MqttManager is the instance built from the MQTTMANAGER_* flags.
+ */
+template <size_t MaxTopicLen, size_t MaxPayloadLen, size_t QueueDepth, typename Limits = MqttManagerLimits>
+class BasicMqttManager {
+    static_assert(MaxTopicLen > 1 && MaxPayloadLen > 0, "BasicMqttManager topic and payload limits must be positive");
+    static_assert(Limits::eventQueueSize >= 8, "Limits::eventQueueSize must leave room for connection events");
 
-class MqttManager {
 public:
-    MqttManager(); // Constructor to initialize default values
+    BasicMqttManager(); // Constructor to initialize default values
+    ~BasicMqttManager(); // Stops the publisher task
     void setServer(const char *server, int port); // Set MQTT server and port
+    bool addServer(const char *server, int port, uint8_t priority = 0); // Add a failover broker (lower priority preferred)
+    void setFailbackInterval(unsigned long intervalMs); // How often to check whether a preferred broker is back (0 = never)
+    void setDnsCacheTtl(unsigned long ttlMs, unsigned long staleMs); // How long resolved broker addresses are used
+    void setResolver(MqttResolver *resolver); // Host name lookup (nullptr restores the default asynchronous DNS)
     void setLwt(const char* topic); // Set LWT topic
     void connect(); // Connect to the MQTT broker
     void reconnect(); // Reconnect to the MQTT broker with exponential backoff
     void onConnect(AsyncMqttClient* client, bool sessionPresent); // Connection callback
     void onDisconnect(AsyncMqttClient* client, AsyncMqttClientDisconnectReason reason); // Disconnection callback
-    void sendMessage(const char *topic, const char *message); // Publish a message
+    MqttPublishHandle sendMessage(const char *topic, const char *message); // Publish a message
+    MqttPublishHandle sendMessage(const char *topic, const char *message, const MqttPublishOptions &options); // ... with QoS/retain/callback
+    MqttPublishHandle sendMessage(const char *topic, const uint8_t *data, size_t length); // Publish a binary payload
+    MqttPublishHandle sendMessage(const char *topic, const uint8_t *data, size_t length, const MqttPublishOptions &options);
+#if __cplusplus >= 201703L
+    MqttPublishHandle sendMessage(const char *topic, std::string_view payload) { // Publish a byte view without strlen
+        return sendMessage(topic, (const uint8_t *)payload.data(), payload.size());
+    }
+    MqttPublishHandle sendMessage(const char *topic, std::string_view payload, const MqttPublishOptions &options) {
+        return sendMessage(topic, (const uint8_t *)payload.data(), payload.size(), options);
+    }
+#endif
+    MqttPublishHandle sendMessage(const char *topic, MqttPayloadLease &&payload); // Publish a leased buffer and release it
+    MqttPublishHandle sendMessage(const char *topic, MqttPayloadLease &&payload, const MqttPublishOptions &options);
+    MqttPublishHandle sendMessage(const char *topic, std::unique_ptr<uint8_t[]> data, size_t length); // Take over a heap buffer
+    MqttPublishHandle sendMessage(const char *topic, std::unique_ptr<uint8_t[]> data, size_t length,
+                                  const MqttPublishOptions &options);
+    MqttPublishHandle queueMessage(const char *topic, const char *message); // Publish from any task; sent by poll()
+    MqttPublishHandle queueMessage(const char *topic, const char *message, const MqttPublishOptions &options);
+    MqttPublishHandle queueMessage(const char *topic, const uint8_t *data, size_t length);
+    MqttPublishHandle queueMessage(const char *topic, const uint8_t *data, size_t length, const MqttPublishOptions &options);
+    MqttPublishHandle queueMessage(const char *topic, MqttPayloadLease &&payload);
+    MqttPublishHandle queueMessage(const char *topic, MqttPayloadLease &&payload, const MqttPublishOptions &options);
+    MqttPublishHandle queueMessage(const char *topic, std::unique_ptr<uint8_t[]> data, size_t length); // Queued without a copy
+    MqttPublishHandle queueMessage(const char *topic, std::unique_ptr<uint8_t[]> data, size_t length,
+                                   const MqttPublishOptions &options);
+    void beginBatch(); // Collect QoS 0 messages until endBatch()...
+    void endBatch(); // ... and write them in one go
+    void setBatchWindow(unsigned long maxDelayMs); // Coalesce QoS 0 messages for at most this long (0 = off)
+    void flushBatch(); // Write collected messages now
+    unsigned long batchWrites(); // Batches written to the connection in a single write
+    bool setTopicVariable(const char *name, const char *value); // Value of {name} in registerTopic() patterns
+    MqttTopic registerTopic(const char *pattern); // Declare a topic once, publish by handle; invalid if it does not fit
+    const char *topicName(MqttTopic topic); // Registered topic, or nullptr
+    MqttPublishHandle sendMessage(MqttTopic topic, const char *message); // Publish to a registered topic
+    MqttPublishHandle sendMessage(MqttTopic topic, const char *message, const MqttPublishOptions &options);
+    MqttPublishHandle sendMessage(MqttTopic topic, const uint8_t *data, size_t length);
+    MqttPublishHandle sendMessage(MqttTopic topic, const uint8_t *data, size_t length, const MqttPublishOptions &options);
+    MqttPublishHandle queueMessage(MqttTopic topic, const char *message); // Queue for a registered topic; the topic is not copied
+    MqttPublishHandle queueMessage(MqttTopic topic, const char *message, const MqttPublishOptions &options);
+    MqttPublishHandle queueMessage(MqttTopic topic, const uint8_t *data, size_t length);
+    MqttPublishHandle queueMessage(MqttTopic topic, const uint8_t *data, size_t length, const MqttPublishOptions &options);
+    void setRateLimit(unsigned long messagesPerSecond, unsigned long burst,
+                      MqttRateLimitPolicy policy = MqttRateLimitPolicy::QUEUE); // Cap all publishes (0 = unlimited)
+    bool setTopicRateLimit(const char *topic, unsigned long messagesPerSecond, unsigned long burst,
+                           MqttRateLimitPolicy policy = MqttRateLimitPolicy::QUEUE); // Cap one topic
+    MqttRateLimitStats rateLimitStats(); // How often the rate limits held messages back
+    MqttPayloadLease leasePayload(size_t capacity); // Pooled buffer to build a payload in; empty when none is free
+    unsigned long payloadPoolExhausted(); // leasePayload() calls that found no free buffer
+    unsigned long queueDropped(); // queueMessage() calls refused: queue full, message too large or no buffer
+    void setDefaultPublishOptions(const MqttPublishOptions &options); // QoS/retain for topics without their own
+    bool setTopicOptions(const char *topic, const MqttPublishOptions &options); // Per-topic QoS/retain default
+    void setInflightWindow(size_t window); // QoS 1/2 messages sent ahead of their acknowledgements
+    size_t inflightCount(); // QoS 1/2 messages awaiting acknowledgement
+    unsigned long acknowledgedCount(); // QoS 1/2 messages acknowledged by the broker
+    void setAckTimeout(unsigned long timeoutMs); // Give up on a QoS 1/2 acknowledgement after this long (0 = never)
+    // After connect(), subscribe() and unsubscribe() need setDeferredDispatch(true): the network task reads the filters
+    bool subscribe(const char *filter, uint8_t qos, MqttMessageHandler handler, void *context = nullptr); // Handle matching messages
+    bool unsubscribe(const char *filter); // Remove every handler of a filter
+    void setMaxInboundLength(size_t length); // Largest inbound payload delivered (up to Limits::maxInboundLen)
+    unsigned long inboundDropped(); // Inbound messages dropped: too large, pool exhausted or incomplete
+    void setDeferredDispatch(bool deferred); // Queue client events for poll() instead of handling them on the network task
+    size_t poll(); // Handle queued client events and publish queued messages; returns how many were handled
+    unsigned long eventsDropped(); // Client events lost because the queue was full
+    bool startPublisherTask(int core, unsigned priority, size_t stackSize = 4096); // Own task does all client work
+    // While it runs, subscribe(), unsubscribe(), the rate limit, outbox and latest-only setters are refused
+    void stopPublisherTask(); // Back to poll()/reconnect() from loop()
+    void setPublisherBatch(size_t messages); // Queued messages published per wakeup before yielding
     bool isConnected(); // Check if the client is connected to the MQTT broker
+    void setOutboxCapacity(size_t capacity); // Messages kept while offline (0 disables the outbox)
+    void setOutboxDropPolicy(MqttDropPolicy policy); // What to discard when the outbox is full
+    void setPrioritySchedule(MqttPrioritySchedule schedule, uint8_t urgentWeight = 4, uint8_t normalWeight = 2,
+                             uint8_t bulkWeight = 1); // Order in which the priority lanes are drained
+    size_t outboxSize(); // Number of messages waiting to be published
+    unsigned long outboxDropped(); // Messages lost to outbox overflow
+    bool setLatestOnly(const char *topic); // Keep only the newest queued message of a state topic
+    unsigned long outboxReplaced(); // Queued messages replaced by a newer one of their latest-only topic
+    void setClock(MqttClock *clock); // Time source for backoff (nullptr restores millis())
+    void setBackoff(MqttBackoff *backoff); // Reconnect delay policy (nullptr restores plain doubling)
+    void setClientId(const char *clientId); // MQTT client ID; also seeds jittered backoff
 
 private:
-    char mqtt_server[16]; // MQTT server IP
-    int mqtt_port; // MQTT port
+    typedef MqttServerList<Limits::maxServers, Limits::maxHostLen> ServerList;
+    ServerList servers; // Brokers with their health records
+    size_t serverIndex; // Server of the current or last connection attempt
+    unsigned long connectStartedAt; // Clock time of the last connect(), for the connect time
+    unsigned long failbackInterval; // Milliseconds between checks for a better broker (0 = never)
+    unsigned long lastFailbackCheck;
+    MqttDefaultResolver defaultResolver; // Default host name lookup
+    MqttResolver *resolver; // Host name lookup in use
+    size_t lookupIndex; // Server whose name is being looked up (Limits::maxServers = none)
+    bool connectAfterLookup; // connect() is waiting for that lookup
+    unsigned long dnsTtl; // Resolved addresses are fresh this long
+    unsigned long dnsStale; // ... and used while revalidating for this much longer
     AsyncMqttClient mqttClient; // MQTT client instance
-    char lwt_topic[64]; // LWT topic
+    char lwt_topic[MaxTopicLen]; // LWT topic
     char offline_message[20] ="off"; // Message when ESP32 goes offline
     char online_message[20] ="on"; // Message when ESP32 comes back online
     unsigned long lastReconnectAttempt; // Time of the last reconnect attempt
     unsigned long reconnectDelay; // The delay before the next reconnection attempt
-    const unsigned long maxReconnectDelay = 32000; // Maximum delay (32 seconds)
+    bool wasConnected; // Connected since the last disconnect, so the next one starts a new backoff sequence
+    ArduinoClock arduinoClock; // Default time source
+    MqttClock *clock; // Time source used for all timing
+    ExponentialBackoff exponentialBackoff; // Default reconnect policy (1 s doubling to 32 s)
+    MqttBackoff *backoff; // Reconnect policy in use
+    char clientId[64]; // Copy kept for AsyncMqttClient, which stores only the pointer
+    MqttOutbox<QueueDepth, MaxTopicLen, MaxPayloadLen, Limits::maxLatestOnly> outbox; // Messages held while offline
+    char latestOnly[Limits::maxLatestOnly][MaxTopicLen]; // setLatestOnly(); the index is the outbox key
+    size_t latestOnlyCount;
+    static const size_t latestOnlyBuckets = 2 * Limits::maxLatestOnly; // Never more than half full
+    uint32_t latestOnlyHash[Limits::maxLatestOnly]; // mqttHash() of each latestOnly topic
+    uint16_t latestOnlyIndex[latestOnlyBuckets]; // Open addressing by hash: latestOnly index, or NO_KEY
+
+    MqttInflight<Limits::inflightSize, MaxTopicLen, MaxPayloadLen> inflight; // Unacknowledged QoS 1/2 messages
+    MqttPublishOptions defaultOptions; // QoS/retain for topics without their own
+    struct TopicOptions {
+        char topic[MaxTopicLen];
+        MqttPublishOptions options;
+    };
+    TopicOptions topicOptions[Limits::maxTopicOptions]; // Per-topic defaults
+    size_t topicOptionsCount;
+    MqttTopicRegistry<Limits::maxTopics, MaxTopicLen, Limits::maxTopicVariables, Limits::maxTopicVariableLen>
+        topics; // registerTopic(), each with a pointer to its TopicOptions entry
+    unsigned long ackTimeout; // Milliseconds to wait for a QoS 1/2 acknowledgement (0 = forever)
+    MqttPublishBatch<Limits::batchBytes, Limits::batchMessages> batch; // QoS 0 packets waiting for one write
+    bool batchOpen; // Between beginBatch() and endBatch()
+    unsigned long batchWindow; // Longest a message waits in the batch (0 = only explicit batches)
+    unsigned long batchWriteCount;
+    MqttTokenBucket rateBucket; // setRateLimit(), shared by all topics
+    MqttRateLimitPolicy ratePolicy;
+    struct TopicRateLimit {
+        char topic[MaxTopicLen];
+        MqttTokenBucket bucket;
+        MqttRateLimitPolicy policy;
+    };
+    TopicRateLimit topicRateLimits[Limits::maxRateLimits]; // setTopicRateLimit()
+    size_t topicRateLimitCount;
+    MqttRateLimitStats rateStats;
+    std::atomic<uint32_t> nextMessageId; // MqttPublishHandle::id of the next sendMessage()/queueMessage() call
+    typedef MqttStoredMessage<MaxTopicLen, MaxPayloadLen> QueuedMessage;
+    struct QueuedEntry {
+        QueuedMessage message;  // Topic, options and id; the payload too unless owned
+        MqttOwnedPayload owned; // Payload moved in by the caller, or empty
+        MqttTopic topic;        // Registered topic; invalid when message.topic holds the topic
+    };
+    MqttMpscQueue<QueuedEntry, Limits::publishQueueSize> publishQueue; // Any task -> poll()
+    std::atomic<unsigned long> queueDropCount;
+    MqttPayloadPool<Limits::payloadSmallSize, Limits::payloadSmallBlocks, Limits::payloadMediumSize,
+                    Limits::payloadMediumBlocks, MaxPayloadLen, Limits::payloadLargeBlocks> payloadPool; // leasePayload()
+
+    bool serverAddress(size_t index, IPAddress &address); // Literal or cached broker address; starts a lookup when due
+    bool startLookup(size_t index); // Look a broker name up in the background; false if none could be started
+    void checkLookup(); // Cache the result of a finished lookup and connect if connect() waits for it
+    MqttTopicTrie<Limits::maxTopicNodes, Limits::maxSubscriptions, Limits::maxTopicLevelLen> subscriptions; // Filters and their handlers
+    bool subscribed[Limits::maxTopicNodes]; // Per trie node: the broker knows this filter
+    uint8_t subscribedQos[Limits::maxTopicNodes]; // ... with this QoS
+
+    typedef MqttInboundBuffer<MaxTopicLen, Limits::maxInboundLen> InboundBuffer;
+    MqttBufferPool<InboundBuffer, Limits::reassemblyBuffers> inboundPool; // Reassembly buffers
+    InboundBuffer *assembling; // Message whose chunks are arriving, or nullptr
+    bool skipping; // Ignore the remaining chunks of a dropped message
+    size_t maxInboundLength; // Ceiling for inbound payloads
+    unsigned long inboundDropCount;
+
+    struct Event {
+        enum Type : uint8_t { CONNECTED, DISCONNECTED, ACKNOWLEDGED, MESSAGE } type;
+        bool sessionPresent;                    // CONNECTED
+        AsyncMqttClientDisconnectReason reason; // DISCONNECTED
+        uint16_t packetId;                      // ACKNOWLEDGED
+        InboundBuffer *buffer;                  // MESSAGE: complete message, released after dispatch
+    };
+    std::atomic<bool> deferred; // Client callbacks only queue events; poll() handles them
+    MqttSpscQueue<Event, Limits::eventQueueSize> events; // Network task -> poll()
+    unsigned long eventDropCount;
+    bool handlingEvents; // handleEvents() is running
+
+    MqttTask publisher; // Optional task that runs poll() and reconnect()
+    size_t publisherBatch;
+
+    void post(const Event &event); // Queue an event from the network task
+    size_t service(size_t publishLimit); // Queued events, then up to publishLimit queued messages
+    size_t handleEvents(); // Client events queued by the network task
+    bool elsewhere(); // The publisher task runs and the caller is not it
+    bool refusedElsewhere(const char *call); // elsewhere(), logged: a setting the task reads cannot change now
+    static void publisherLoop(void *manager); // Body of the publisher task
+    void abandonAssembly(); // Drop a chunked message that will not complete
+    void assembled(InboundBuffer *buffer); // A chunked or copied message is complete
+    void dispatch(const MqttInboundMessage &message); // Hand a complete message to the matching handlers
+    void onMessage(char *topic, char *payload, AsyncMqttClientMessageProperties properties, size_t len,
+                   size_t index, size_t total); // Message from the client
+    void subscribeAll(); // Send SUBSCRIBE for every filter the broker does not know yet
+    const MqttPublishOptions &optionsFor(const char *topic); // Per-topic default or the global one
+    const MqttPublishOptions *topicOptionsOf(const char *topic); // Per-topic default, or nullptr
+    MqttPublishHandle sendTopic(MqttTopic topic, const char *payload, size_t length,
+                                const MqttPublishOptions *options); // Publish by handle (nullptr: topic's options)
+    MqttPublishHandle queueTopic(MqttTopic topic, const char *payload, size_t length, const MqttPublishOptions *options,
+                                 uint32_t id); // Queue by handle
+    uint32_t nextId(); // Allocate a handle id; safe from any task
+    MqttPublishHandle sendPayload(const char *topic, const char *payload, size_t length,
+                                  const MqttPublishOptions &options, uint32_t id); // Shared publish path
+    MqttPublishHandle queuePayload(const char *topic, const char *payload, size_t length,
+                                   const MqttPublishOptions &options, uint32_t id); // Shared queueMessage() path
+    MqttPublishHandle queueOwned(const char *topic, MqttOwnedPayload &&payload, const MqttPublishOptions &options,
+                                 uint32_t id); // Queue a payload without copying it
+    MqttPublishHandle sendOwned(const char *topic, MqttOwnedPayload &&payload, const MqttPublishOptions &options,
+                                uint32_t id); // Publish a payload the manager owns
+    MqttPublishHandle enqueued(uint32_t id); // Handle of a queued message
+    MqttPublishHandle queueRefused(uint32_t id, const MqttPublishOptions &options); // Count and report a refused message
+    MqttPublishHandle dropped(uint32_t id, const MqttPublishOptions &options); // Report a message that cannot be sent
+    size_t drainPublishQueue(size_t limit); // Publish what other tasks queued; poll() only
+    bool publishNow(const char *topic, const char *payload, size_t length, const MqttPublishOptions &options,
+                    MqttPublishHandle &handle); // Hand one message to the client
+    void drainOutbox(); // Publish queued messages in order while connected
+    uint16_t latestOnlyKey(const char *topic, uint32_t hash, size_t *bucket); // Outbox key of a topic, or NO_KEY
+    bool queue(const char *topic, const char *payload, size_t length, const MqttPublishOptions &options,
+               uint32_t id); // Put a message in the outbox, over the queued one of a latest-only topic
+    bool batchMessage(const char *topic, const char *payload, size_t length, const MqttPublishOptions &options,
+                      uint32_t id); // Add a QoS 0 message to the batch
+    bool writeBatch(); // The whole batch in one client write (MQTTMANAGER_BATCH_RAW_WRITE)
+    void flushDueBatch(); // Flush once the oldest batched message has waited batchWindow
+    TopicRateLimit *topicRateLimit(const char *topic); // Rate limit of a topic, or nullptr
+    bool rateAllows(const char *topic, MqttRateLimitPolicy *policy = nullptr); // Tokens available; else the policy
+    bool topicHeld(const char *topic); // The topic's own bucket is empty
+    void rateTake(const char *topic); // Spend the tokens of a published message
+    bool throttle(const char *topic, const char *payload, size_t length, const MqttPublishOptions &options,
+                  MqttPublishHandle &handle, MqttRateLimitPolicy policy); // Drop or coalesce an over-budget message
+    void onPublishAcknowledged(uint16_t packetId); // PUBACK/PUBCOMP from the client
+    void requeueInflight(); // Put unacknowledged messages back in the outbox after a disconnect
+    void expireInflight(); // Give up on acknowledgements older than ackTimeout
+    void complete(const MqttPublishHandle &handle, const MqttPublishOptions &options); // Run the completion callback
+    static void onOutboxDrop(const QueuedMessage &message, void *manager); // Report messages evicted from the outbox
 };
 
+#include "MqttManagerImpl.h"
+
+// The manager sized by the MQTTMANAGER_* build flags, compiled once in MqttManager.cpp
+typedef BasicMqttManager<MQTTMANAGER_MAX_TOPIC_LEN, MQTTMANAGER_MAX_PAYLOAD_LEN, MQTTMANAGER_OUTBOX_SIZE> MqttManager;
+extern template class BasicMqttManager<MQTTMANAGER_MAX_TOPIC_LEN, MQTTMANAGER_MAX_PAYLOAD_LEN, MQTTMANAGER_OUTBOX_SIZE>;
+
 #endif // MQTTMANAGER_H
@@ -0,0 +1,1536 @@
+#ifndef MQTTMANAGERIMPL_H
+#define MQTTMANAGERIMPL_H
+
+/*
+ * Member definitions of BasicMqttManager, included at the end of MqttManager.h.
+ * Usage and design notes are in MqttManager.cpp.
+ */
+
+#include "MqttLog.h"
+
+#define MQTTMANAGER_TEMPLATE template <size_t MaxTopicLen, size_t MaxPayloadLen, size_t QueueDepth, typename Limits>
+#define MQTTMANAGER_CLASS BasicMqttManager<MaxTopicLen, MaxPayloadLen, QueueDepth, Limits>
+
+MQTTMANAGER_TEMPLATE
+MQTTMANAGER_CLASS::BasicMqttManager()
+    : serverIndex(Limits::maxServers), // No server selected yet
+      connectStartedAt(0),
+      failbackInterval(60000), // Look for a better broker once a minute
+      lastFailbackCheck(0),
+      resolver(&defaultResolver),
+      lookupIndex(Limits::maxServers),
+      connectAfterLookup(false),
+      dnsTtl(300000), // Resolve broker names again after 5 minutes...
+      dnsStale(3600000), // ... but keep connecting to the old address for up to an hour while that happens
+      lastReconnectAttempt(0), // Start with no reconnect attempts
+      reconnectDelay(1000), // Start with 1 second delay
+      wasConnected(false),
+      clock(&arduinoClock), // Read time from millis() unless a clock is injected
+      backoff(&exponentialBackoff),
+      latestOnlyCount(0),
+      defaultOptions(0, true), // QoS 0, retained: the behavior before options existed
+      topicOptionsCount(0),
+      ackTimeout(30000), // Give up on a missing PUBACK after 30 seconds
+      batchOpen(false),
+      batchWindow(0), // Every message is written on its own, as before batching existed
+      batchWriteCount(0),
+      ratePolicy(MqttRateLimitPolicy::QUEUE),
+      topicRateLimitCount(0),
+      rateStats(),
+      nextMessageId(1),
+      queueDropCount(0),
+      assembling(nullptr),
+      skipping(false),
+      maxInboundLength(Limits::maxInboundLen),
+      inboundDropCount(0),
+      deferred(false), // reconnect() and sendMessage() handle queued client events, as before poll() existed
+      eventDropCount(0),
+      handlingEvents(false),
+      publisherBatch(8)
+{
+    static_assert(Limits::ramBudget == 0 || sizeof(BasicMqttManager) <= Limits::ramBudget,
+                  "BasicMqttManager does not fit in Limits::ramBudget; raise it with the limits");
+    clientId[0] = '\0';
+    for (size_t i = 0; i < latestOnlyBuckets; i++) {
+        latestOnlyIndex[i] = decltype(outbox)::NO_KEY;
+    }
+    outbox.setDropHandler(onOutboxDrop, this); // Evicted messages complete as DROPPED
+
+    // Connection changes and acknowledgements touch the outbox and the in-flight table, so they are
+    // always handled on the task that publishes:
+    // by poll(), or also by reconnect() and sendMessage() when dispatch is not deferred
+    mqttClient.onConnect([this](bool sessionPresent) {
+        Event event = {Event::CONNECTED};
+        event.sessionPresent = sessionPresent;
+        post(event);
+    });
+
+    mqttClient.onDisconnect([this](AsyncMqttClientDisconnectReason reason) {
+        abandonAssembly(); // The rest of a chunked message will not arrive
+        Event event = {Event::DISCONNECTED};
+        event.reason = reason;
+        post(event);
+    });
+
+    mqttClient.onPublish([this](uint16_t packetId) {
+        Event event = {Event::ACKNOWLEDGED}; // The in-flight table belongs to the publishing task too
+        event.packetId = packetId;
+        post(event);
+    });
+
+    mqttClient.onMessage([this](char *topic, char *payload, AsyncMqttClientMessageProperties properties, size_t len,
+                                size_t index, size_t total) {
+        onMessage(topic, payload, properties, len, index, total); // Dispatch to subscribed handlers
+    });
+    memset(subscribed, 0, sizeof(subscribed));
+}
+
+MQTTMANAGER_TEMPLATE
+MQTTMANAGER_CLASS::~BasicMqttManager() {
+    stopPublisherTask(); // Before any member it uses is destroyed
+}
+
+// Set the MQTT server and port
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setServer(const char *server, int port) {
+    servers.clear();
+    lookupIndex = Limits::maxServers; // The answer would be for a server that is gone
+    connectAfterLookup = false;
+    addServer(server, port, 0);
+}
+
+// Add a broker to the failover list; servers with a lower priority value are preferred
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::addServer(const char *server, int port, uint8_t priority) {
+    if (!servers.add(server, port, priority)) {
+        MQTT_LOGE("MQTT server not added: %s", server);
+        return false;
+    }
+    return true;
+}
+
+// How often a connection to a backup broker checks whether a preferred one can be retried
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setFailbackInterval(unsigned long intervalMs) {
+    failbackInterval = intervalMs;
+}
+
+// Resolved broker addresses are fresh for ttlMs and still used for staleMs after that while they are revalidated
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setDnsCacheTtl(unsigned long ttlMs, unsigned long staleMs) {
+    dnsTtl = ttlMs;
+    dnsStale = staleMs;
+}
+
+// A lookup still running on the previous resolver is abandoned
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setResolver(MqttResolver *resolver) {
+    this->resolver = resolver ? resolver : &defaultResolver;
+    lookupIndex = Limits::maxServers;
+    connectAfterLookup = false;
+}
+
+/*
+ * Address to connect to: literals as they are, names from the cache. A cached address that is too
+ * old or failed is looked up again in the background and used until the answer is in; without
+ * one there is nothing to connect to until the lookup finishes.
+ */
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::serverAddress(size_t index, IPAddress &address) {
+    auto &server = servers.at(index);
+    if (server.addressState == ServerList::LITERAL) {
+        address = server.address;
+        return true;
+    }
+    bool cached = server.addressState == ServerList::RESOLVED;
+    if (!cached || server.revalidate || clock->millis() - server.resolvedAt >= dnsTtl + dnsStale) {
+        startLookup(index);
+    }
+    if (cached) {
+        address = server.address; // Fresh, stale or being revalidated
+    }
+    return cached;
+}
+
+// The resolver never blocks, so this is safe from loop() and the publisher task alike
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::startLookup(size_t index) {
+    if (lookupIndex == index) {
+        return true; // Already running
+    }
+    if (lookupIndex != Limits::maxServers || !resolver->begin(servers.at(index).host)) {
+        return false;
+    }
+    lookupIndex = index;
+    return true;
+}
+
+// Polled by reconnect() and poll(); on failure a previously resolved address is kept and used
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::checkLookup() {
+    if (lookupIndex == Limits::maxServers) {
+        return;
+    }
+    IPAddress resolved;
+    MqttLookupStatus status = resolver->status(resolved);
+    if (status == MqttLookupStatus::PENDING) {
+        return;
+    }
+    size_t index = lookupIndex;
+    auto &server = servers.at(index);
+    lookupIndex = Limits::maxServers;
+    if (status == MqttLookupStatus::RESOLVED) {
+        MQTT_LOGD("Resolved %s to %u.%u.%u.%u", server.host, resolved[0], resolved[1], resolved[2], resolved[3]);
+        server.address = resolved;
+        server.addressState = ServerList::RESOLVED;
+    } else if (server.addressState == ServerList::RESOLVED) {
+        MQTT_LOGW("DNS lookup for %s failed, keeping the cached address", server.host);
+    } else {
+        MQTT_LOGE("Could not resolve MQTT server %s", server.host);
+        servers.recordFailure(index, clock->millis()); // Try another server next time
+        connectAfterLookup = false; // reconnect() tries again after its backoff
+        return;
+    }
+    server.resolvedAt = clock->millis(); // A failed lookup also waits a full TTL before the next try
+    server.revalidate = false;
+    if (connectAfterLookup) {
+        connectAfterLookup = false;
+        connect();
+    }
+}
+
+// Set the LWT (Last Will and Testament) topic
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setLwt(const char* topic) {
+    strncpy(lwt_topic, topic, sizeof(lwt_topic) - 1);
+    lwt_topic[sizeof(lwt_topic) - 1] = '\0';
+}
+
+// Connect to the MQTT broker
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::connect() {
+    if (elsewhere()) {
+        return; // The publisher task keeps the connection up
+    }
+    if (!mqttClient.connected()) {
+        MQTT_LOGI("Connecting to MQTT server...");
+        serverIndex = servers.select(clock->millis()); // Best healthy broker
+        if (serverIndex == Limits::maxServers) {
+            MQTT_LOGE("No MQTT server configured");
+            return;
+        }
+        auto &server = servers.at(serverIndex);
+        IPAddress address;
+        if (!serverAddress(serverIndex, address)) {
+            if (lookupIndex == serverIndex) {
+                connectAfterLookup = true; // checkLookup() connects once the name is resolved
+                return;
+            }
+            MQTT_LOGE("Could not resolve MQTT server %s", server.host);
+            servers.recordFailure(serverIndex, clock->millis()); // Try another server next time
+            return;
+        }
+        MQTT_LOGD("MQTT server %s:%u", server.host, server.port);
+        mqttClient.setServer(address, server.port); // Set server and port
+        mqttClient.setKeepAlive(60); // Set the keep-alive interval (60 seconds)
+        
+        // Set LWT message (offline message)
+        mqttClient.setWill(lwt_topic, 0, true, offline_message); 
+        
+        connectStartedAt = clock->millis();
+        mqttClient.connect(); // Start the connection
+    }
+}
+
+// Reconnect to the MQTT broker with exponential backoff
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::reconnect() {
+    if (elsewhere()) {
+        return; // The publisher task keeps the connection up
+    }
+    if (!deferred) {
+        handleEvents(); // Connection events and acknowledgements queued by the network task
+    }
+    checkLookup(); // A finished DNS lookup may be what the next connect() waits for
+    expireInflight(); // reconnect() is the periodic call, so acknowledgement timeouts are checked here
+    flushDueBatch(); // ... and so is the batch window
+    if (mqttClient.connected() && !outbox.empty()) {
+        drainOutbox(); // ... and messages the rate limits held back are released
+    }
+
+    // Attempt to reconnect if not already connected
+    unsigned long now = clock->millis();
+    if (!mqttClient.connected() && now - lastReconnectAttempt >= reconnectDelay) {
+        MQTT_LOGI("Attempting MQTT reconnect...");
+
+        // Backoff logic: the next attempt is timed from the start of this one
+        lastReconnectAttempt = now;
+        reconnectDelay = backoff->nextDelay(); // Wait before the next attempt if this one fails
+
+        connect(); // Try to reconnect
+    } else if (mqttClient.connected() && serverIndex < servers.size() &&
+               servers.at(serverIndex).addressState == ServerList::RESOLVED &&
+               now - servers.at(serverIndex).resolvedAt >= dnsTtl) {
+        // Refresh the cached address in the background while connected, so a reconnect never waits for DNS
+        startLookup(serverIndex);
+    } else if (mqttClient.connected() && failbackInterval && now - lastFailbackCheck >= failbackInterval) {
+        // On a backup broker: once a preferred one is out of quarantine, drop this connection to retry it
+        lastFailbackCheck = now;
+        if (servers.preferredOver(serverIndex, now)) {
+            MQTT_LOGI("Failing back to the preferred MQTT server");
+            mqttClient.disconnect();
+        }
+    }
+}
+
+// Handle connection success
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::onConnect(AsyncMqttClient* client, bool sessionPresent) {
+    MQTT_LOGI("Connected to MQTT broker");
+    servers.recordSuccess(serverIndex, clock->millis() - connectStartedAt);
+    lastFailbackCheck = clock->millis();
+
+    // Send online message when successfully connected, ahead of anything queued while offline
+    mqttClient.publish(lwt_topic, 0, true, online_message);
+
+    backoff->reset(); // The next outage starts a fresh backoff sequence
+    wasConnected = true;
+
+    if (!sessionPresent) {
+        memset(subscribed, 0, sizeof(subscribed)); // New session: the broker forgot our subscriptions
+    }
+    subscribeAll();
+
+    flushBatch(); // Collected before the connection dropped: behind whatever the outbox holds
+    drainOutbox(); // Deliver messages queued while offline
+}
+
+
+// Handle disconnection
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::onDisconnect(AsyncMqttClient* client, AsyncMqttClientDisconnectReason reason) {
+    MQTT_LOGI("Disconnected from MQTT broker");
+    if (wasConnected) {
+        // Connection lost (not a failed attempt): the first retry waits firstDelay() from now
+        wasConnected = false;
+        lastReconnectAttempt = clock->millis();
+        reconnectDelay = backoff->firstDelay();
+    } else if (serverIndex < servers.size()) {
+        servers.recordFailure(serverIndex, clock->millis()); // Quarantine it; the next attempt picks another
+        auto &server = servers.at(serverIndex);
+        if (clock->millis() - server.resolvedAt >= dnsTtl) {
+            server.revalidate = true; // A stale address that fails may be outdated: look the name up again
+        }
+    }
+    requeueInflight(); // Unacknowledged QoS 1/2 messages go out again after reconnecting
+    reconnect(); // Start reconnect process
+}
+
+// Send a message to a specific MQTT topic
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(const char *topic, const char *message) {
+    return sendPayload(topic, message, strlen(message), optionsFor(topic), nextId());
+}
+
+// Send a message with explicit QoS, retain flag and completion callback
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(const char *topic, const char *message, const MqttPublishOptions &options) {
+    return sendPayload(topic, message, strlen(message), options, nextId());
+}
+
+// Send a binary payload of the given length (may contain NUL bytes)
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(const char *topic, const uint8_t *data, size_t length) {
+    return sendPayload(topic, (const char *)data, length, optionsFor(topic), nextId());
+}
+
+// Send a binary payload with explicit QoS, retain flag and completion callback
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(const char *topic, const uint8_t *data, size_t length,
+                                                 const MqttPublishOptions &options) {
+    return sendPayload(topic, (const char *)data, length, options, nextId());
+}
+
+// Queue a message for poll() to publish; safe to call from any task or core
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(const char *topic, const char *message) {
+    return queuePayload(topic, message, strlen(message), optionsFor(topic), nextId());
+}
+
+// Queue a message with explicit QoS, retain flag and completion callback
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(const char *topic, const char *message, const MqttPublishOptions &options) {
+    return queuePayload(topic, message, strlen(message), options, nextId());
+}
+
+// Queue a binary payload of the given length
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(const char *topic, const uint8_t *data, size_t length) {
+    return queuePayload(topic, (const char *)data, length, optionsFor(topic), nextId());
+}
+
+// Queue a binary payload with explicit QoS, retain flag and completion callback
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(const char *topic, const uint8_t *data, size_t length,
+                                                  const MqttPublishOptions &options) {
+    return queuePayload(topic, (const char *)data, length, options, nextId());
+}
+
+// Publish a leased buffer; the block goes back to the pool once the message is handed on
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(const char *topic, MqttPayloadLease &&payload) {
+    return sendOwned(topic, MqttOwnedPayload(std::move(payload)), optionsFor(topic), nextId());
+}
+
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(const char *topic, MqttPayloadLease &&payload,
+                                                 const MqttPublishOptions &options) {
+    return sendOwned(topic, MqttOwnedPayload(std::move(payload)), options, nextId());
+}
+
+// Publish a heap buffer the caller gives up; it is freed once the message is handed on
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(const char *topic, std::unique_ptr<uint8_t[]> data, size_t length) {
+    return sendOwned(topic, MqttOwnedPayload(std::move(data), length), optionsFor(topic), nextId());
+}
+
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(const char *topic, std::unique_ptr<uint8_t[]> data, size_t length,
+                                                 const MqttPublishOptions &options) {
+    return sendOwned(topic, MqttOwnedPayload(std::move(data), length), options, nextId());
+}
+
+// Queue a leased buffer; the queue holds the block itself until poll() publishes it
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(const char *topic, MqttPayloadLease &&payload) {
+    return queueOwned(topic, MqttOwnedPayload(std::move(payload)), optionsFor(topic), nextId());
+}
+
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(const char *topic, MqttPayloadLease &&payload,
+                                                  const MqttPublishOptions &options) {
+    return queueOwned(topic, MqttOwnedPayload(std::move(payload)), options, nextId());
+}
+
+// Queue a heap buffer the caller gives up; the queue holds it until poll() publishes it
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(const char *topic, std::unique_ptr<uint8_t[]> data, size_t length) {
+    return queueOwned(topic, MqttOwnedPayload(std::move(data), length), optionsFor(topic), nextId());
+}
+
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(const char *topic, std::unique_ptr<uint8_t[]> data, size_t length,
+                                                  const MqttPublishOptions &options) {
+    return queueOwned(topic, MqttOwnedPayload(std::move(data), length), options, nextId());
+}
+
+// Set the value that replaces {name} in patterns registered afterwards
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::setTopicVariable(const char *name, const char *value) {
+    return topics.setVariable(name, value);
+}
+
+// Expand a pattern once and return its handle; registering the same topic again returns the same handle
+MQTTMANAGER_TEMPLATE
+MqttTopic MQTTMANAGER_CLASS::registerTopic(const char *pattern) {
+    MqttTopic topic = topics.add(pattern, nullptr);
+    if (topic.valid()) {
+        topics.setOptions(topic, topicOptionsOf(topics.topic(topic)));
+    } else {
+        MQTT_LOGE("MQTT topic %s could not be registered", pattern);
+    }
+    return topic;
+}
+
+MQTTMANAGER_TEMPLATE
+const char *MQTTMANAGER_CLASS::topicName(MqttTopic topic) {
+    return topics.contains(topic) ? topics.topic(topic) : nullptr;
+}
+
+// Publish text to a registered topic with its per-topic or the default options
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(MqttTopic topic, const char *message) {
+    return sendTopic(topic, message, strlen(message), nullptr);
+}
+
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(MqttTopic topic, const char *message, const MqttPublishOptions &options) {
+    return sendTopic(topic, message, strlen(message), &options);
+}
+
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(MqttTopic topic, const uint8_t *data, size_t length) {
+    return sendTopic(topic, (const char *)data, length, nullptr);
+}
+
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendMessage(MqttTopic topic, const uint8_t *data, size_t length,
+                                                 const MqttPublishOptions &options) {
+    return sendTopic(topic, (const char *)data, length, &options);
+}
+
+// Queue text for a registered topic; the queue stores the handle instead of the topic
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(MqttTopic topic, const char *message) {
+    return queueTopic(topic, message, strlen(message), nullptr, nextId());
+}
+
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(MqttTopic topic, const char *message, const MqttPublishOptions &options) {
+    return queueTopic(topic, message, strlen(message), &options, nextId());
+}
+
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(MqttTopic topic, const uint8_t *data, size_t length) {
+    return queueTopic(topic, (const char *)data, length, nullptr, nextId());
+}
+
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueMessage(MqttTopic topic, const uint8_t *data, size_t length,
+                                                  const MqttPublishOptions &options) {
+    return queueTopic(topic, (const char *)data, length, &options, nextId());
+}
+
+// Publish by handle: no topic lookup, options come with the registry entry
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendTopic(MqttTopic topic, const char *payload, size_t length,
+                                               const MqttPublishOptions *options) {
+    if (!topics.contains(topic)) {
+        return dropped(nextId(), options ? *options : defaultOptions);
+    }
+    if (!options) {
+        options = topics.options(topic) ? topics.options(topic) : &defaultOptions;
+    }
+    if (elsewhere()) {
+        return queueTopic(topic, payload, length, options, nextId()); // The publisher task talks to the client
+    }
+    return sendPayload(topics.topic(topic), payload, length, *options, nextId());
+}
+
+// Copy the payload into the publish queue together with the topic handle
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueTopic(MqttTopic topic, const char *payload, size_t length,
+                                                const MqttPublishOptions *options, uint32_t id) {
+    if (!topics.contains(topic)) {
+        return queueRefused(id, options ? *options : defaultOptions);
+    }
+    if (!options) {
+        options = topics.options(topic) ? topics.options(topic) : &defaultOptions;
+    }
+    bool queued = length <= MaxPayloadLen && publishQueue.push([&](QueuedEntry &entry) {
+        entry.message.topic[0] = '\0';
+        entry.message.assignPayload(payload, length, *options, id);
+        entry.topic = topic;
+    });
+    return queued ? enqueued(id) : queueRefused(id, *options);
+}
+
+// A buffer to build a payload in without touching the heap; safe from any task
+MQTTMANAGER_TEMPLATE
+MqttPayloadLease MQTTMANAGER_CLASS::leasePayload(size_t capacity) {
+    return payloadPool.lease(capacity);
+}
+
+// leasePayload() calls that got an empty lease
+MQTTMANAGER_TEMPLATE
+unsigned long MQTTMANAGER_CLASS::payloadPoolExhausted() {
+    return payloadPool.exhausted();
+}
+
+// Copy the message into the publish queue; it is published (or outboxed) by the next poll()
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queuePayload(const char *topic, const char *payload, size_t length,
+                                                  const MqttPublishOptions &options, uint32_t id) {
+    bool queued = QueuedMessage::fits(topic, length) && publishQueue.push([&](QueuedEntry &entry) {
+        entry.message.assign(topic, payload, length, options, id);
+        entry.topic = MqttTopic();
+    });
+    return queued ? enqueued(id) : queueRefused(id, options);
+}
+
+// Move an owned payload into the publish queue; only the topic is copied
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueOwned(const char *topic, MqttOwnedPayload &&payload,
+                                                const MqttPublishOptions &options, uint32_t id) {
+    MqttOwnedPayload owned(std::move(payload)); // Freed here unless the queue takes it
+    if (!owned) {
+        return queueRefused(id, options);
+    }
+    bool queued = QueuedMessage::fits(topic, 0) && publishQueue.push([&](QueuedEntry &entry) {
+        entry.message.assign(topic, "", 0, options, id);
+        entry.owned = std::move(owned);
+        entry.topic = MqttTopic();
+    });
+    return queued ? enqueued(id) : queueRefused(id, options);
+}
+
+// A message is in the publish queue: wake the publisher task if it sleeps
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::enqueued(uint32_t id) {
+    MqttPublishHandle handle = {id, 0, MqttDeliveryStatus::QUEUED};
+    if (publisher.running()) {
+        publisher.notify();
+    }
+    return handle;
+}
+
+// Queue full, message too large or no payload buffer
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::queueRefused(uint32_t id, const MqttPublishOptions &options) {
+    queueDropCount.fetch_add(1, std::memory_order_relaxed);
+    return dropped(id, options); // On the calling task: poll() never sees this message
+}
+
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::dropped(uint32_t id, const MqttPublishOptions &options) {
+    MqttPublishHandle handle = {id, 0, MqttDeliveryStatus::DROPPED};
+    complete(handle, options);
+    return handle;
+}
+
+// Hand up to limit queued messages to the normal publish path, oldest first
+MQTTMANAGER_TEMPLATE
+size_t MQTTMANAGER_CLASS::drainPublishQueue(size_t limit) {
+    size_t drained = 0;
+    while (drained < limit && publishQueue.pop([this](QueuedEntry &entry) {
+        QueuedMessage &message = entry.message;
+        const char *topic = entry.topic.valid() ? topics.topic(entry.topic) : message.topic;
+        if (entry.owned) {
+            sendPayload(topic, (const char *)entry.owned.data(), entry.owned.length(), message.options, message.id);
+            entry.owned.reset(); // The client, outbox or in-flight table has what it needs
+        } else {
+            sendPayload(topic, (const char *)message.payload, message.length, message.options, message.id);
+        }
+    })) {
+        drained++;
+    }
+    return drained;
+}
+
+// Publish an owned payload straight from its buffer, or move it to the publisher task
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendOwned(const char *topic, MqttOwnedPayload &&payload,
+                                               const MqttPublishOptions &options, uint32_t id) {
+    if (elsewhere()) {
+        return queueOwned(topic, std::move(payload), options, id);
+    }
+    MqttOwnedPayload owned(std::move(payload)); // Freed when this returns
+    if (!owned) {
+        return dropped(id, options);
+    }
+    return sendPayload(topic, (const char *)owned.data(), owned.length(), options, id);
+}
+
+// queueMessage() calls that did not fit in the queue
+MQTTMANAGER_TEMPLATE
+unsigned long MQTTMANAGER_CLASS::queueDropped() {
+    return queueDropCount.load(std::memory_order_relaxed);
+}
+
+// Next MqttPublishHandle::id; 0 is never a valid id
+MQTTMANAGER_TEMPLATE
+uint32_t MQTTMANAGER_CLASS::nextId() {
+    uint32_t id = nextMessageId.fetch_add(1, std::memory_order_relaxed);
+    return id ? id : nextMessageId.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Common publish path for text and binary payloads
+MQTTMANAGER_TEMPLATE
+MqttPublishHandle MQTTMANAGER_CLASS::sendPayload(const char *topic, const char *payload, size_t length,
+                                                 const MqttPublishOptions &options, uint32_t id) {
+    if (elsewhere()) {
+        return queuePayload(topic, payload, length, options, id); // The publisher task talks to the client
+    }
+    if (!deferred) {
+        handleEvents(); // A new connection drains the outbox, and acknowledgements free the window, first
+    }
+    MqttPublishHandle handle = {id, 0, MqttDeliveryStatus::QUEUED};
+
+    if (length == 0) {
+        payload = ""; // AsyncMqttClient treats length 0 as "use strlen(payload)"
+    }
+
+    // Over its rate limit: dropped, coalesced with a queued message or queued like any other
+    MqttRateLimitPolicy policy;
+    if (mqttClient.connected() && !rateAllows(topic, &policy) &&
+        throttle(topic, payload, length, options, handle, policy)) {
+        return handle;
+    }
+
+    // QoS 0 messages join the batch when batching; SENT is reported when the batch is written
+    if (options.qos == 0 && (batchOpen || batchWindow) && mqttClient.connected() && outbox.empty() &&
+        rateAllows(topic) && batchMessage(topic, payload, length, options, id)) {
+        rateTake(topic);
+        return handle;
+    }
+    flushBatch(); // Anything else must not overtake the batched messages
+
+    // Publish right away unless that would overtake queued messages of the same or a higher priority
+    // (other than those of topics over their own rate limit), overflow the in-flight window or the rate
+    bool windowFull = options.qos > 0 && inflight.full();
+    auto ready = [this](const QueuedMessage &message) { return !topicHeld(message.topic); };
+    if (mqttClient.connected() && !outbox.waiting(options.priority, ready) && !windowFull && rateAllows(topic) &&
+        publishNow(topic, payload, length, options, handle)) {
+        rateTake(topic);
+        MQTT_LOGD("MQTT message sent: %s (%u bytes, QoS %u)", topic, (unsigned)length, options.qos);
+        if (handle.status == MqttDeliveryStatus::SENT) {
+            complete(handle, options);
+        }
+        return handle;
+    }
+
+    if (!queue(topic, payload, length, options, handle.id)) {
+        MQTT_LOGE("MQTT outbox full, message dropped!");
+        handle.status = MqttDeliveryStatus::DROPPED;
+        complete(handle, options);
+    }
+
+    if (mqttClient.connected()) {
+        drainOutbox();
+    } else {
+        MQTT_LOGW("MQTT not connected, message queued");
+        reconnect(); // Try to reconnect if disconnected
+    }
+    return handle;
+}
+
+// Hand one message to the client and track it until acknowledged if QoS > 0
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::publishNow(const char *topic, const char *payload, size_t length,
+                                   const MqttPublishOptions &options, MqttPublishHandle &handle) {
+    uint16_t packetId = mqttClient.publish(topic, options.qos, options.retain, payload, length);
+    if (packetId == 0) {
+        return false; // Client could not take it (e.g. out of memory)
+    }
+    if (options.qos > 0) {
+        inflight.add(packetId, clock->millis(), topic, payload, length, options, handle.id);
+        handle.packetId = packetId;
+        handle.status = MqttDeliveryStatus::IN_FLIGHT;
+    } else {
+        handle.status = MqttDeliveryStatus::SENT;
+    }
+    return true;
+}
+
+/*
+ * Publish queued messages in order until the outbox is empty, the window is full, the global rate
+ * limit is reached or the client refuses one. Messages of a topic over its own rate limit are
+ * passed over and stay queued in order, so one throttled topic does not hold up the others.
+ */
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::drainOutbox() {
+    auto ready = [this](const QueuedMessage &message) { return !topicHeld(message.topic); };
+    const auto *message = outbox.front(ready);
+    while (message && mqttClient.connected()) {
+        if (message->options.qos > 0 && inflight.full()) {
+            break; // Resumes when an acknowledgement frees a slot
+        }
+        if (!rateAllows(message->topic)) {
+            break; // Resumes from poll()/reconnect() once the global bucket has refilled
+        }
+        MqttPublishHandle handle = {message->id, 0, MqttDeliveryStatus::QUEUED};
+        MqttPublishOptions options = message->options;
+        if (!publishNow(message->topic, message->payload, message->length, options, handle)) {
+            break; // Retry on the next call
+        }
+        rateTake(message->topic);
+        outbox.pop(message);
+        if (handle.status == MqttDeliveryStatus::SENT) {
+            complete(handle, options); // After pop(), so the callback sees a consistent outbox
+        }
+        message = outbox.front(ready);
+    }
+}
+
+/*
+ * Latest-only topics are keyed by their index in latestOnly, found through a hash table, so the
+ * lookup costs one pass over the topic however many topics are latest-only. A topic held back by its own rate limit only ever displaces its own messages: when the
+ * outbox is full, DROP_OLDEST evicts its oldest queued message and DROP_NEWEST refuses it.
+ */
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::queue(const char *topic, const char *payload, size_t length,
+                              const MqttPublishOptions &options, uint32_t id) {
+    if (outbox.full() && topicHeld(topic) &&
+        (outbox.dropPolicy() == MqttDropPolicy::DROP_NEWEST || !outbox.evictOldest(topic, options.priority))) {
+        return false;
+    }
+    uint16_t key = latestOnlyCount ? latestOnlyKey(topic, mqttHash(topic), nullptr) : decltype(outbox)::NO_KEY;
+    return outbox.push(topic, payload, length, options, id, key);
+}
+
+// Index of a latest-only topic, or NO_KEY; bucket (if given) is set to the empty bucket the probe ended on
+MQTTMANAGER_TEMPLATE
+uint16_t MQTTMANAGER_CLASS::latestOnlyKey(const char *topic, uint32_t hash, size_t *bucket) {
+    size_t at = hash % latestOnlyBuckets;
+    while (latestOnlyIndex[at] != decltype(outbox)::NO_KEY) {
+        uint16_t key = latestOnlyIndex[at];
+        if (latestOnlyHash[key] == hash && strcmp(latestOnly[key], topic) == 0) {
+            return key;
+        }
+        at = (at + 1) % latestOnlyBuckets;
+    }
+    if (bucket) {
+        *bucket = at;
+    }
+    return decltype(outbox)::NO_KEY;
+}
+
+// Add a QoS 0 message to the batch, writing the batch first if it is full
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::batchMessage(const char *topic, const char *payload, size_t length,
+                                     const MqttPublishOptions &options, uint32_t id) {
+    size_t topicLength = strlen(topic);
+    if (topicLength >= MaxTopicLen || !batch.fits(topicLength, length)) {
+        return false; // Too large to batch: published on its own
+    }
+    if (!batch.add(topic, topicLength, payload, length, options, id, clock->millis())) {
+        flushBatch();
+        if (!mqttClient.connected() || !outbox.empty() ||
+            !batch.add(topic, topicLength, payload, length, options, id, clock->millis())) {
+            return false;
+        }
+    }
+    flushDueBatch();
+    return true;
+}
+
+/*
+ * Write the batch, oldest first. Without MQTTMANAGER_BATCH_RAW_WRITE (or when the write fails)
+ * every message is published on its own, back to back; messages the client refuses go to the
+ * outbox like any other, so the order is kept.
+ */
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::flushBatch() {
+    if (batch.empty() || elsewhere()) {
+        return;
+    }
+    bool written = mqttClient.connected() && outbox.empty() && writeBatch();
+    for (size_t i = 0; i < batch.messages(); i++) {
+        const auto &entry = batch.at(i);
+        char topic[MaxTopicLen];
+        memcpy(topic, batch.data() + entry.topic, entry.topicLength);
+        topic[entry.topicLength] = '\0';
+        const char *payload = entry.length ? (const char *)batch.data() + entry.payload : "";
+        MqttPublishHandle handle = {entry.id, 0, MqttDeliveryStatus::SENT};
+        if (written || (mqttClient.connected() && outbox.empty() &&
+                        publishNow(topic, payload, entry.length, entry.options, handle))) {
+            complete(handle, entry.options);
+        } else if (!queue(topic, payload, entry.length, entry.options, entry.id)) {
+            MQTT_LOGE("MQTT outbox full, message dropped!");
+            handle.status = MqttDeliveryStatus::DROPPED;
+            complete(handle, entry.options);
+        }
+    }
+    batch.clear();
+}
+
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::writeBatch() {
+#ifdef MQTTMANAGER_BATCH_RAW_WRITE
+    if (mqttClient.writeRaw(batch.data(), batch.size())) {
+        MQTT_LOGD("MQTT batch written: %u messages, %u bytes", (unsigned)batch.messages(), (unsigned)batch.size());
+        batchWriteCount++;
+        return true;
+    }
+    return false;
+#else
+    return false; // No raw write: flushBatch() publishes each message
+#endif
+}
+
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::flushDueBatch() {
+    if (!batch.empty() && !batchOpen && clock->millis() - batch.since() >= batchWindow) {
+        flushBatch();
+    }
+}
+
+// Collect the following QoS 0 messages into one write; nothing is written before endBatch()
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::beginBatch() {
+    if (!elsewhere()) {
+        batchOpen = true;
+    }
+}
+
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::endBatch() {
+    if (!elsewhere()) {
+        batchOpen = false;
+        flushBatch();
+    }
+}
+
+// Nagle-like coalescing: QoS 0 messages wait up to maxDelayMs, or until the batch is full
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setBatchWindow(unsigned long maxDelayMs) {
+    batchWindow = maxDelayMs;
+    flushDueBatch();
+}
+
+MQTTMANAGER_TEMPLATE
+unsigned long MQTTMANAGER_CLASS::batchWrites() {
+    return batchWriteCount;
+}
+
+/*
+ * Limit all publishes to messagesPerSecond on average with bursts of up to burst messages
+ * (0 messages per second removes the limit). What happens to messages over the limit is up
+ * to policy; queued messages are released from poll()/reconnect() as tokens come back.
+ */
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setRateLimit(unsigned long messagesPerSecond, unsigned long burst,
+                                     MqttRateLimitPolicy policy) {
+    if (refusedElsewhere("setRateLimit")) {
+        return;
+    }
+    rateBucket.configure(messagesPerSecond, burst, clock->millis());
+    ratePolicy = policy;
+}
+
+// Limit one topic on top of the global limit; false when the table is full or the topic too long
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::setTopicRateLimit(const char *topic, unsigned long messagesPerSecond, unsigned long burst,
+                                          MqttRateLimitPolicy policy) {
+    if (refusedElsewhere("setTopicRateLimit")) {
+        return false;
+    }
+    TopicRateLimit *limit = topicRateLimit(topic);
+    if (!limit) {
+        if (topicRateLimitCount == Limits::maxRateLimits || strlen(topic) >= MaxTopicLen) {
+            return false;
+        }
+        limit = &topicRateLimits[topicRateLimitCount++];
+        strcpy(limit->topic, topic);
+    }
+    limit->bucket.configure(messagesPerSecond, burst, clock->millis());
+    limit->policy = policy;
+    return true;
+}
+
+MQTTMANAGER_TEMPLATE
+MqttRateLimitStats MQTTMANAGER_CLASS::rateLimitStats() {
+    return rateStats;
+}
+
+MQTTMANAGER_TEMPLATE
+typename MQTTMANAGER_CLASS::TopicRateLimit *MQTTMANAGER_CLASS::topicRateLimit(const char *topic) {
+    for (size_t i = 0; i < topicRateLimitCount; i++) {
+        if (strcmp(topicRateLimits[i].topic, topic) == 0) {
+            return &topicRateLimits[i];
+        }
+    }
+    return nullptr;
+}
+
+// Whether both the topic's bucket and the global one have a token; if not, policy is the empty one's
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::rateAllows(const char *topic, MqttRateLimitPolicy *policy) {
+    if (!rateBucket.limited() && topicRateLimitCount == 0) {
+        return true; // No limits: no lookup on the publish path
+    }
+    unsigned long now = clock->millis();
+    TopicRateLimit *limit = topicRateLimit(topic);
+    if (limit && !limit->bucket.ready(now)) {
+        if (policy) {
+            *policy = limit->policy;
+        }
+        return false;
+    }
+    if (!rateBucket.ready(now)) {
+        if (policy) {
+            *policy = ratePolicy;
+        }
+        return false;
+    }
+    return true;
+}
+
+// Whether the topic has a rate limit of its own and its bucket is empty
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::topicHeld(const char *topic) {
+    if (topicRateLimitCount == 0) {
+        return false;
+    }
+    TopicRateLimit *limit = topicRateLimit(topic);
+    return limit && !limit->bucket.ready(clock->millis());
+}
+
+// Called after rateAllows() returned true and the message went out
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::rateTake(const char *topic) {
+    if (!rateBucket.limited() && topicRateLimitCount == 0) {
+        return;
+    }
+    rateBucket.take();
+    if (TopicRateLimit *limit = topicRateLimit(topic)) {
+        limit->bucket.take();
+    }
+}
+
+/*
+ * Apply the policy of an empty bucket. Returns false for messages that take the normal path
+ * to the outbox (QUEUE, or COALESCE with nothing to replace); those are counted as queued.
+ */
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::throttle(const char *topic, const char *payload, size_t length,
+                                 const MqttPublishOptions &options, MqttPublishHandle &handle,
+                                 MqttRateLimitPolicy policy) {
+    if (policy == MqttRateLimitPolicy::DROP) {
+        MQTT_LOGW("MQTT rate limit reached, message dropped: %s", topic);
+        rateStats.dropped++;
+        handle.status = MqttDeliveryStatus::DROPPED;
+        complete(handle, options);
+        return true;
+    }
+    if (policy == MqttRateLimitPolicy::COALESCE) {
+        QueuedMessage *queued = outbox.findLast(topic, options.priority);
+        if (queued && QueuedMessage::fits(topic, length)) {
+            MqttPublishHandle replaced = {queued->id, 0, MqttDeliveryStatus::DROPPED};
+            MqttPublishOptions replacedOptions = queued->options;
+            queued->assign(topic, payload, length, options, handle.id); // Keeps the older message's place
+            rateStats.coalesced++;
+            complete(replaced, replacedOptions);
+            return true;
+        }
+    }
+    rateStats.queued++;
+    return false;
+}
+
+// A QoS 1/2 publish was acknowledged: free its slot and send what was waiting for it
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::onPublishAcknowledged(uint16_t packetId) {
+    auto *entry = inflight.find(packetId);
+    if (entry) {
+        MqttPublishHandle handle = {entry->message.id, packetId, MqttDeliveryStatus::ACKNOWLEDGED};
+        MqttPublishOptions options = entry->message.options;
+        servers.recordRtt(serverIndex, clock->millis() - entry->sentAt); // Ranks brokers of equal priority
+        inflight.release(entry, true);
+        complete(handle, options);
+        drainOutbox();
+    }
+}
+
+// The client forgets unacknowledged messages on disconnect; queue them again, oldest first
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::requeueInflight() {
+    while (auto *entry = inflight.newest()) {
+        bool requeued = entry->stored && outbox.pushFront(entry->message);
+        MqttPublishHandle handle = {entry->message.id, entry->packetId, MqttDeliveryStatus::DROPPED};
+        MqttPublishOptions options = entry->message.options;
+        inflight.release(entry, false);
+        if (!requeued) {
+            MQTT_LOGE("MQTT unacknowledged message dropped!");
+            complete(handle, options);
+        }
+    }
+}
+
+// Stop waiting for acknowledgements that are overdue and let queued messages use the window
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::expireInflight() {
+    if (ackTimeout == 0) {
+        return;
+    }
+    bool expired = false;
+    while (auto *entry = inflight.expired(clock->millis(), ackTimeout)) {
+        MqttPublishHandle handle = {entry->message.id, entry->packetId, MqttDeliveryStatus::TIMED_OUT};
+        MqttPublishOptions options = entry->message.options;
+        inflight.release(entry, false);
+        MQTT_LOGW("MQTT acknowledgement timed out (packet %u)", handle.packetId);
+        complete(handle, options);
+        expired = true;
+    }
+    if (expired) {
+        drainOutbox();
+    }
+}
+
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::complete(const MqttPublishHandle &handle, const MqttPublishOptions &options) {
+    if (options.onComplete) {
+        options.onComplete(handle, options.context);
+    }
+}
+
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::onOutboxDrop(const QueuedMessage &message, void *manager) {
+    MqttPublishHandle handle = {message.id, 0, MqttDeliveryStatus::DROPPED};
+    ((BasicMqttManager *)manager)->complete(handle, message.options);
+}
+
+// QoS/retain used by sendMessage() overloads without explicit options
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setDefaultPublishOptions(const MqttPublishOptions &options) {
+    defaultOptions = options;
+}
+
+// Give a topic its own default QoS/retain; returns false when the table is full or the topic too long
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::setTopicOptions(const char *topic, const MqttPublishOptions &options) {
+    for (size_t i = 0; i < topicOptionsCount; i++) {
+        if (strcmp(topicOptions[i].topic, topic) == 0) {
+            topicOptions[i].options = options;
+            return true;
+        }
+    }
+    if (topicOptionsCount == Limits::maxTopicOptions || strlen(topic) >= MaxTopicLen) {
+        return false;
+    }
+    strcpy(topicOptions[topicOptionsCount].topic, topic);
+    topicOptions[topicOptionsCount].options = options;
+    topics.setOptions(topics.find(topic), &topicOptions[topicOptionsCount].options); // Registered before its options
+    topicOptionsCount++;
+    return true;
+}
+
+MQTTMANAGER_TEMPLATE
+const MqttPublishOptions *MQTTMANAGER_CLASS::topicOptionsOf(const char *topic) {
+    for (size_t i = 0; i < topicOptionsCount; i++) {
+        if (strcmp(topicOptions[i].topic, topic) == 0) {
+            return &topicOptions[i].options;
+        }
+    }
+    return nullptr;
+}
+
+MQTTMANAGER_TEMPLATE
+const MqttPublishOptions &MQTTMANAGER_CLASS::optionsFor(const char *topic) {
+    const MqttPublishOptions *options = topicOptionsOf(topic);
+    return options ? *options : defaultOptions;
+}
+
+// Limit how many QoS 1/2 messages may await acknowledgement at once
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setInflightWindow(size_t window) {
+    inflight.setWindow(window);
+}
+
+// Number of QoS 1/2 messages awaiting acknowledgement
+MQTTMANAGER_TEMPLATE
+size_t MQTTMANAGER_CLASS::inflightCount() {
+    return inflight.size();
+}
+
+// Number of QoS 1/2 messages acknowledged by the broker
+MQTTMANAGER_TEMPLATE
+unsigned long MQTTMANAGER_CLASS::acknowledgedCount() {
+    return inflight.ackedCount();
+}
+
+// How long to wait for a QoS 1/2 acknowledgement before completing the message as TIMED_OUT
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setAckTimeout(unsigned long timeoutMs) {
+    ackTimeout = timeoutMs;
+}
+
+/*
+ * Register a handler for a topic filter (`+` and `#` wildcards allowed) and subscribe to it.
+ * Without deferred dispatch the network task reads the filters for every message, so after
+ * connect() only call this (and unsubscribe()) with setDeferredDispatch(true).
+ */
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::subscribe(const char *filter, uint8_t qos, MqttMessageHandler handler, void *context) {
+    if (refusedElsewhere("subscribe")) {
+        return false;
+    }
+    if (!handler || qos > 2 || strlen(filter) >= MaxTopicLen ||
+        subscriptions.add(filter, qos, handler, context) == subscriptions.NONE) {
+        MQTT_LOGE("MQTT subscription not added: %s", filter);
+        return false;
+    }
+    if (mqttClient.connected()) {
+        subscribeAll(); // Otherwise onConnect does it
+    }
+    return true;
+}
+
+// Remove every handler registered for exactly this filter and unsubscribe from it
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::unsubscribe(const char *filter) {
+    if (refusedElsewhere("unsubscribe")) {
+        return false;
+    }
+    uint16_t node = subscriptions.find(filter);
+    if (node == subscriptions.NONE || !subscriptions.remove(filter)) {
+        return false;
+    }
+    if (subscribed[node] && mqttClient.connected()) {
+        mqttClient.unsubscribe(filter);
+    }
+    subscribed[node] = false;
+    return true;
+}
+
+// Subscribe to filters the broker does not know yet, or with a QoS raised by a new handler
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::subscribeAll() {
+    char filter[MaxTopicLen];
+    subscriptions.forEachFilter(filter, sizeof(filter), [this](uint16_t node, const char *filter) {
+        uint8_t qos = subscriptions.qos(node);
+        if ((!subscribed[node] || subscribedQos[node] < qos) && mqttClient.subscribe(filter, qos)) {
+            subscribed[node] = true;
+            subscribedQos[node] = qos;
+            MQTT_LOGD("MQTT subscribed to %s (QoS %u)", filter, qos);
+        }
+    });
+}
+
+// Deliver a received message, reassembling it first if the client hands it over in chunks
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::onMessage(char *topic, char *payload, AsyncMqttClientMessageProperties properties, size_t len,
+                                  size_t index, size_t total) {
+    if (index == 0) {
+        abandonAssembly(); // The previous message never completed
+        skipping = false;
+        if (total > maxInboundLength) {
+            MQTT_LOGW("MQTT message on %s too large (%u bytes), dropped", topic, (unsigned)total);
+            skipping = true;
+            inboundDropCount++;
+            return;
+        }
+        if (len == total && !deferred) {
+            // Complete in one piece: dispatch straight from the client's buffer
+            MqttInboundMessage message = {topic, (const uint8_t *)payload, len, properties.qos, properties.retain};
+            dispatch(message);
+            return;
+        }
+        // Chunked, or deferred to poll() after the client's buffer is gone: copy it into a pool buffer
+        assembling = strlen(topic) < sizeof(assembling->topic) ? inboundPool.acquire() : nullptr;
+        if (!assembling) {
+            MQTT_LOGW("MQTT message on %s dropped, no inbound buffer", topic);
+            skipping = true;
+            inboundDropCount++;
+            return;
+        }
+        strcpy(assembling->topic, topic);
+        assembling->received = 0;
+        assembling->total = total;
+        assembling->qos = properties.qos;
+        assembling->retain = properties.retain;
+    }
+
+    if (skipping) {
+        return;
+    }
+    if (!assembling || index != assembling->received || index + len > assembling->total) {
+        MQTT_LOGW("MQTT message chunk out of sequence, dropped");
+        if (!assembling) {
+            inboundDropCount++;
+        }
+        abandonAssembly();
+        skipping = true;
+        return;
+    }
+    memcpy(assembling->payload + index, payload, len);
+    assembling->received += len;
+    if (assembling->received == assembling->total) {
+        InboundBuffer *complete = assembling;
+        assembling = nullptr;
+        assembled(complete);
+    }
+}
+
+// Dispatch a complete pool buffer now, or hand it to poll() in deferred mode
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::assembled(InboundBuffer *buffer) {
+    if (deferred) {
+        Event event = {Event::MESSAGE};
+        event.buffer = buffer;
+        post(event);
+        return;
+    }
+    dispatch(buffer->message());
+    inboundPool.release(buffer);
+}
+
+// Release the buffer of a message whose remaining chunks will not arrive
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::abandonAssembly() {
+    if (assembling) {
+        inboundPool.release(assembling);
+        assembling = nullptr;
+        inboundDropCount++;
+    }
+}
+
+// Hand a complete message to every handler whose filter matches its topic
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::dispatch(const MqttInboundMessage &message) {
+    if (subscriptions.dispatch(message) == 0) {
+        MQTT_LOGD("MQTT message on %s has no handler", message.topic);
+    }
+}
+
+// Largest inbound payload handed to handlers; larger messages are dropped
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setMaxInboundLength(size_t length) {
+    maxInboundLength = length < Limits::maxInboundLen ? length : (size_t)Limits::maxInboundLen;
+}
+
+// Inbound messages that never reached a handler because of size, pool or sequence problems
+MQTTMANAGER_TEMPLATE
+unsigned long MQTTMANAGER_CLASS::inboundDropped() {
+    return inboundDropCount;
+}
+
+// Handle client events in the task that calls poll() (normally loop()) instead of the network task.
+// Switch before connect(): events already handled on the network task are not replayed.
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setDeferredDispatch(bool deferred) {
+    this->deferred = deferred;
+}
+
+// Queue an event for poll(). Messages and acknowledgements leave the last slots to connection
+// events, so a burst of traffic cannot hide a connect or disconnect.
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::post(const Event &event) {
+    bool traffic = event.type == Event::MESSAGE || event.type == Event::ACKNOWLEDGED;
+    if ((!traffic || events.size() < Limits::eventQueueSize - 3) && events.push(event)) {
+        if (publisher.running()) {
+            publisher.notify();
+        }
+        return;
+    }
+    eventDropCount++;
+    if (event.type == Event::MESSAGE) {
+        inboundPool.release(event.buffer);
+        inboundDropCount++;
+    }
+}
+
+// Handle the events queued by the network task since the last call, in order, then publish
+// the messages other tasks queued with queueMessage(). Does nothing while the publisher task runs.
+MQTTMANAGER_TEMPLATE
+size_t MQTTMANAGER_CLASS::poll() {
+    if (elsewhere()) {
+        return 0;
+    }
+    return service(Limits::publishQueueSize);
+}
+
+// Body of poll(), shared with the publisher task
+MQTTMANAGER_TEMPLATE
+size_t MQTTMANAGER_CLASS::service(size_t publishLimit) {
+    size_t handled = handleEvents();
+    checkLookup();
+    handled += drainPublishQueue(publishLimit); // Publishing from this task serializes all client writes
+    flushDueBatch();
+    if (mqttClient.connected() && !outbox.empty()) {
+        drainOutbox(); // Release messages the rate limits held back
+    }
+    return handled;
+}
+
+// Handle events queued by the network task; not re-entered from the handlers it runs
+MQTTMANAGER_TEMPLATE
+size_t MQTTMANAGER_CLASS::handleEvents() {
+    if (handlingEvents) {
+        return 0;
+    }
+    handlingEvents = true;
+    size_t handled = 0;
+    Event event;
+    // Bounded, so a producer that keeps up with us cannot hold loop() here
+    while (handled < Limits::eventQueueSize && events.pop(event)) {
+        switch (event.type) {
+        case Event::CONNECTED:
+            onConnect(&mqttClient, event.sessionPresent);
+            break;
+        case Event::DISCONNECTED:
+            onDisconnect(&mqttClient, event.reason);
+            break;
+        case Event::ACKNOWLEDGED:
+            onPublishAcknowledged(event.packetId);
+            break;
+        case Event::MESSAGE:
+            dispatch(event.buffer->message());
+            inboundPool.release(event.buffer);
+            break;
+        }
+        handled++;
+    }
+    handlingEvents = false;
+    return handled;
+}
+
+// Client events lost to a full queue in deferred mode
+MQTTMANAGER_TEMPLATE
+unsigned long MQTTMANAGER_CLASS::eventsDropped() {
+    return eventDropCount;
+}
+
+/*
+ * Move all client work to a task of its own: poll() and reconnect() run there, client events are
+ * deferred to it, and sendMessage() from any other task only queues the message. Call it after
+ * connect(). core is a CPU number (MqttTask::ANY_CORE for no pinning); priority and stack size
+ * are FreeRTOS task parameters. False on cores without tasks (anything but the ESP32 and the host).
+ */
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::startPublisherTask(int core, unsigned priority, size_t stackSize) {
+    if (publisher.running()) {
+        return false;
+    }
+    bool wasDeferred = deferred;
+    deferred = true; // From now on only the publisher task touches manager state
+    if (!publisher.start("mqtt_publisher", publisherLoop, this, core, priority, stackSize)) {
+        MQTT_LOGE("Could not start the MQTT publisher task");
+        deferred = wasDeferred;
+        return false;
+    }
+    return true;
+}
+
+// Stop the publisher task. Client events stay deferred, so loop() calls poll() again from here on.
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::stopPublisherTask() {
+    publisher.stop();
+}
+
+// Queued messages the publisher task sends before letting other tasks run
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setPublisherBatch(size_t messages) {
+    publisherBatch = messages ? messages : 1;
+}
+
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::elsewhere() {
+    return publisher.running() && !publisher.current();
+}
+
+// The publisher task reads the outbox, rate limits and subscriptions without a lock, so they only
+// change while it is not running
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::refusedElsewhere(const char *call) {
+    if (!elsewhere()) {
+        return false;
+    }
+    MQTT_LOGE("MQTT %s() refused while the publisher task runs; call it before startPublisherTask()", call);
+    return true;
+}
+
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::publisherLoop(void *manager) {
+    BasicMqttManager *self = (BasicMqttManager *)manager;
+    while (!self->publisher.stopRequested()) {
+        size_t handled = self->service(self->publisherBatch);
+        self->reconnect();
+        if (handled >= self->publisherBatch) {
+            self->publisher.yield(); // More may be queued: let the application run between batches
+        } else {
+            unsigned long sleep = 50; // Woken early by queued messages and client events; 50 ms keeps timers going
+            if (!self->batch.empty() && self->batchWindow < sleep) {
+                sleep = self->batchWindow; // Do not hold batched messages past their window
+            }
+            self->publisher.wait(sleep);
+        }
+    }
+}
+
+// This method returns whether the MQTT client is connected
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::isConnected() {
+    return mqttClient.connected(); // Return the connection status of the MQTT client
+}
+
+// Use a different time source (nullptr restores millis())
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setClock(MqttClock *clock) {
+    this->clock = clock ? clock : &arduinoClock;
+}
+
+// Select the reconnect delay policy; it is seeded from the current client ID
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setBackoff(MqttBackoff *backoff) {
+    this->backoff = backoff ? backoff : &exponentialBackoff;
+    this->backoff->seed(MqttBackoff::seedFrom(mqttClient.getClientId()));
+}
+
+// Set the MQTT client ID (truncated to 63 characters) and reseed the backoff with it
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setClientId(const char *clientId) {
+    strncpy(this->clientId, clientId, sizeof(this->clientId) - 1);
+    this->clientId[sizeof(this->clientId) - 1] = '\0';
+    mqttClient.setClientId(this->clientId);
+    backoff->seed(MqttBackoff::seedFrom(this->clientId));
+}
+
+// Limit how many messages are kept while offline
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setOutboxCapacity(size_t capacity) {
+    if (refusedElsewhere("setOutboxCapacity")) {
+        return;
+    }
+    outbox.setCapacity(capacity);
+}
+
+// Choose which message to discard when the outbox is full
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setOutboxDropPolicy(MqttDropPolicy policy) {
+    if (refusedElsewhere("setOutboxDropPolicy")) {
+        return;
+    }
+    outbox.setDropPolicy(policy);
+}
+
+/*
+ * Which queued message goes next: STRICT drains URGENT, then NORMAL, then BULK; WEIGHTED lets
+ * the waiting priorities take turns, urgentWeight URGENT messages for every normalWeight NORMAL
+ * and bulkWeight BULK ones, so a BULK backlog still moves while alarms keep coming.
+ */
+MQTTMANAGER_TEMPLATE
+void MQTTMANAGER_CLASS::setPrioritySchedule(MqttPrioritySchedule schedule, uint8_t urgentWeight,
+                                            uint8_t normalWeight, uint8_t bulkWeight) {
+    if (refusedElsewhere("setPrioritySchedule")) {
+        return;
+    }
+    outbox.setSchedule(schedule, urgentWeight, normalWeight, bulkWeight);
+}
+
+// Number of messages waiting to be published
+MQTTMANAGER_TEMPLATE
+size_t MQTTMANAGER_CLASS::outboxSize() {
+    return outbox.size();
+}
+
+// Number of messages lost because the outbox was full or the message did not fit a slot
+MQTTMANAGER_TEMPLATE
+unsigned long MQTTMANAGER_CLASS::outboxDropped() {
+    return outbox.droppedCount();
+}
+
+/*
+ * Queue at most one message of topic: a newer one takes the place of the queued one, which is
+ * reported DROPPED. Meant for state topics, where replaying stale values after an outage only
+ * delays the current one. Returns false when the table is full or the topic too long.
+ */
+MQTTMANAGER_TEMPLATE
+bool MQTTMANAGER_CLASS::setLatestOnly(const char *topic) {
+    if (refusedElsewhere("setLatestOnly")) {
+        return false;
+    }
+    uint32_t hash = mqttHash(topic);
+    size_t bucket;
+    if (latestOnlyKey(topic, hash, &bucket) != decltype(outbox)::NO_KEY) {
+        return true;
+    }
+    if (latestOnlyCount == Limits::maxLatestOnly || strlen(topic) >= MaxTopicLen) {
+        return false;
+    }
+    strcpy(latestOnly[latestOnlyCount], topic);
+    latestOnlyHash[latestOnlyCount] = hash;
+    latestOnlyIndex[bucket] = (uint16_t)latestOnlyCount++;
+    return true;
+}
+
+// Number of queued messages replaced by a newer message of the same latest-only topic
+MQTTMANAGER_TEMPLATE
+unsigned long MQTTMANAGER_CLASS::outboxReplaced() {
+    return outbox.replacedCount();
+}
+
+#undef MQTTMANAGER_TEMPLATE
+#undef MQTTMANAGER_CLASS
+
+#endif // MQTTMANAGERIMPL_H
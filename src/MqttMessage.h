@@ -0,0 +1,129 @@
+#ifndef MQTTMESSAGE_H
+#define MQTTMESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// FNV-1a of a NUL-terminated string (nullptr hashes like ""), for seeds and topic lookups
+inline uint32_t mqttHash(const char *text) {
+    uint32_t hash = 2166136261u;
+    while (text && *text) {
+        hash = (hash ^ (uint8_t)*text++) * 16777619u;
+    }
+    return hash;
+}
+
+// Where a message is on its way to the broker
+enum class MqttDeliveryStatus : uint8_t {
+    SENT,         // Handed to the client; final for QoS 0
+    QUEUED,       // Waiting in the outbox
+    IN_FLIGHT,    // QoS 1/2 published, waiting for the broker's acknowledgement
+    ACKNOWLEDGED, // QoS 1/2 acknowledged by the broker
+    DROPPED,      // Discarded: outbox full, too large to queue, replaced by a newer value, or lost with the connection
+    TIMED_OUT     // QoS 1/2 not acknowledged within the ack timeout
+};
+
+// What sendMessage() did with a message; also passed to its completion callback
+struct MqttPublishHandle {
+    uint32_t id;               // Unique per sendMessage() call, never 0
+    uint16_t packetId;         // Client packet ID while a QoS 1/2 message is in flight, otherwise 0
+    MqttDeliveryStatus status;
+
+    // False once the message is known to be lost
+    bool ok() const { return status != MqttDeliveryStatus::DROPPED && status != MqttDeliveryStatus::TIMED_OUT; }
+};
+
+/*
+ * Called once per message when its status becomes final: SENT for QoS 0,
+ * ACKNOWLEDGED for QoS 1/2, or DROPPED / TIMED_OUT. context is the pointer
+ * given in MqttPublishOptions, e.g. the sample buffer to release. It runs on
+ * the publishing task, never on the MQTT client's: inside sendMessage(),
+ * reconnect() or poll(), or on the publisher task while that runs. It may be
+ * called halfway through an outbox or in-flight table update, which the
+ * event re-entry guard does not cover, so keep it short and do not call
+ * sendMessage() from it; queueMessage() is safe and is published by poll().
+ */
+typedef void (*MqttCompletionCallback)(const MqttPublishHandle &handle, void *context);
+
+// A message received on a subscribed topic; payload is not NUL-terminated
+struct MqttInboundMessage {
+    const char *topic;
+    const uint8_t *payload;
+    size_t length;
+    uint8_t qos;
+    bool retain;
+};
+
+// Called for each received message whose topic matches the handler's filter
+typedef void (*MqttMessageHandler)(const MqttInboundMessage &message, void *context);
+
+// Pool block a message delivered in several chunks is reassembled into
+template <size_t MaxTopicLen, size_t MaxPayloadLen>
+struct MqttInboundBuffer {
+    char topic[MaxTopicLen];         // NUL-terminated topic
+    uint8_t payload[MaxPayloadLen];  // Payload bytes as they arrive
+    size_t received;                 // Bytes copied so far
+    size_t total;                    // Payload length announced with the first chunk
+    uint8_t qos;
+    bool retain;
+
+    // The completed message, pointing into this buffer
+    MqttInboundMessage message() const {
+        MqttInboundMessage result = {topic, payload, total, qos, retain};
+        return result;
+    }
+};
+
+// Outbox lane of a message that cannot be published right away
+enum class MqttPriority : uint8_t {
+    URGENT, // Alarms: go ahead of queued NORMAL and BULK messages
+    NORMAL, // Default
+    BULK    // Telemetry backlogs that may wait
+};
+
+// How a message is published
+struct MqttPublishOptions {
+    uint8_t qos; // 0 = at most once, 1 = at least once, 2 = exactly once
+    bool retain; // Ask the broker to keep the message as the topic's last known value
+    MqttPriority priority; // Lane while queued; a message never waits for queued ones of lower priority
+    MqttCompletionCallback onComplete; // Optional, see MqttCompletionCallback
+    void *context;                     // Passed to onComplete
+
+    MqttPublishOptions(uint8_t qos = 0, bool retain = true, MqttCompletionCallback onComplete = nullptr,
+                       void *context = nullptr, MqttPriority priority = MqttPriority::NORMAL)
+        : qos(qos), retain(retain), priority(priority), onComplete(onComplete), context(context) {}
+};
+
+// A message copied into fixed-size storage (outbox slots, in-flight entries)
+template <size_t MaxTopicLen, size_t MaxPayloadLen>
+struct MqttStoredMessage {
+    char topic[MaxTopicLen];         // NUL-terminated topic
+    char payload[MaxPayloadLen + 1]; // Payload bytes, NUL-terminated for text callers
+    size_t length;                   // Payload length in bytes
+    MqttPublishOptions options;
+    uint32_t id;                     // MqttPublishHandle::id of the sendMessage() call
+
+    // Whether a message of this size fits the storage
+    static bool fits(const char *topic, size_t length) {
+        return strlen(topic) < MaxTopicLen && length <= MaxPayloadLen;
+    }
+
+    // Copy a message in; the caller checks fits() first
+    void assign(const char *topic, const char *payload, size_t length, const MqttPublishOptions &options,
+                uint32_t id) {
+        memcpy(this->topic, topic, strlen(topic) + 1);
+        assignPayload(payload, length, options, id);
+    }
+
+    // Copy everything but the topic in; length must not exceed MaxPayloadLen
+    void assignPayload(const char *payload, size_t length, const MqttPublishOptions &options, uint32_t id) {
+        memcpy(this->payload, payload, length);
+        this->payload[length] = '\0';
+        this->length = length;
+        this->options = options;
+        this->id = id;
+    }
+};
+
+#endif // MQTTMESSAGE_H
@@ -0,0 +1,87 @@
+#ifndef MQTTMPSCQUEUE_H
+#define MQTTMPSCQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Bounded lock-free multi-producer/single-consumer queue of Capacity items
+ * (D. Vyukov's bounded queue with one consumer).
+ *
+ * Every cell carries a sequence number that says whose turn it is: producers
+ * claim a cell with one compare-and-swap on the shared tail and publish it by
+ * advancing its sequence, the consumer takes cells in order and hands them
+ * back the same way. Producers never wait for each other while filling a cell
+ * and never block on the consumer; a full queue makes push() fail at once.
+ * Items are filled and read in place, so large items are copied only once.
+ * Capacity must be a power of two.
+ */
+template <typename T, size_t Capacity>
+class MqttMpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "MqttMpscQueue capacity must be a power of two");
+
+public:
+    MqttMpscQueue() : tail(0), head(0) {
+        for (size_t i = 0; i < Capacity; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /*
+     * Any task. Claims a cell and calls fill(T &) on it; returns false without
+     * calling fill when the queue is full. fill must not fail: the cell is
+     * published as soon as it returns.
+     */
+    template <typename Fill>
+    bool push(Fill fill) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &cells[position & (Capacity - 1)];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+            if (difference == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break; // Cell claimed
+                }
+            } else if (difference < 0) {
+                return false; // The consumer has not freed this cell yet: full
+            } else {
+                position = tail.load(std::memory_order_relaxed); // Another producer got it first
+            }
+        }
+        fill(cell->item);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*
+     * Consumer only. Calls visit(T &) on the oldest item and frees its cell;
+     * returns false when the queue is empty (or the oldest cell is still
+     * being filled).
+     */
+    template <typename Visit>
+    bool pop(Visit visit) {
+        Cell &cell = cells[head & (Capacity - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+        visit(cell.item);
+        cell.sequence.store(head + Capacity, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence; // == position: free for that push; == position + 1: ready to pop
+        T item;
+    };
+
+    Cell cells[Capacity];
+    std::atomic<size_t> tail; // Next position to claim; shared by the producers
+    size_t head;              // Next position to pop; consumer only
+};
+
+#endif // MQTTMPSCQUEUE_H
@@ -0,0 +1,398 @@
+#ifndef MQTTOUTBOX_H
+#define MQTTOUTBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MqttMessage.h"
+
+// What to throw away when a message arrives and the outbox is already full
+enum class MqttDropPolicy : uint8_t {
+    DROP_OLDEST, // Evict the oldest queued message to make room (keeps the freshest data)
+    DROP_NEWEST  // Reject the incoming message (keeps the earliest data)
+};
+
+// Which priority lane the outbox drains next
+enum class MqttPrioritySchedule : uint8_t {
+    STRICT,  // Always the most urgent non-empty lane; less urgent lanes wait until it is empty
+    WEIGHTED // Non-empty lanes take turns in proportion to their weights, so none starves
+};
+
+/*
+ * Bounded queue of messages waiting to be published, with one FIFO lane per
+ * MqttPriority.
+ *
+ * All slots are allocated inline when the outbox is constructed and shared by
+ * the lanes, which link their slots in order both ways, so queueing a message
+ * is a plain copy into a free slot, never touches the heap, and any queued
+ * message can be taken out in O(1). The compile-time Capacity is the storage
+ * size; setCapacity() can lower the usable depth at runtime (0 disables
+ * queueing altogether). front()/pop() take the oldest message of the lane the
+ * schedule picks; front(ready) passes over messages that cannot go yet, such
+ * as those of a topic over its rate limit, so they do not hold up the rest.
+ * When the outbox is full, room is made in the least urgent non-empty lane, so
+ * a message never displaces a more urgent one. Queued messages the outbox
+ * throws away to make room are reported to the drop handler; messages that are
+ * refused outright are reported through the false return of
+ * push()/pushFront().
+ *
+ * Messages pushed with a key below Keys are "latest only": each key remembers
+ * the slot of its queued message, so a newer message with the same key
+ * overwrites that slot in place, in O(1), instead of queueing behind it. A
+ * newer message with another priority moves to the back of its own lane
+ * instead. The replaced message is reported to the drop handler too.
+ */
+template <size_t Capacity, size_t MaxTopicLen, size_t MaxPayloadLen, size_t Keys = 0>
+class MqttOutbox {
+    static_assert(Capacity > 0 && Capacity < 0xFFFF, "MqttOutbox needs 1 to 65534 slots");
+    static_assert(Keys < 0xFFFF, "MqttOutbox has too many keys");
+
+public:
+    typedef MqttStoredMessage<MaxTopicLen, MaxPayloadLen> Message;
+    typedef void (*DropHandler)(const Message &message, void *context);
+    static const uint16_t NO_KEY = 0xFFFF; // Key of messages that are always queued
+    static const size_t LANES = 3;         // One per MqttPriority
+
+    MqttOutbox()
+        : count(0),
+          capacity(Capacity),
+          policy(MqttDropPolicy::DROP_OLDEST),
+          schedule(MqttPrioritySchedule::STRICT),
+          dropped(0),
+          replaced(0),
+          dropHandler(nullptr),
+          dropContext(nullptr)
+    {
+        setSchedule(MqttPrioritySchedule::STRICT, 4, 2, 1);
+        clear();
+    }
+
+    // Called for every queued message that is evicted
+    void setDropHandler(DropHandler handler, void *context) {
+        dropHandler = handler;
+        dropContext = context;
+    }
+
+    // Limit the usable depth (clamped to Capacity); excess messages are dropped least urgent and oldest first
+    void setCapacity(size_t newCapacity) {
+        capacity = newCapacity < Capacity ? newCapacity : Capacity;
+        while (count > capacity) {
+            size_t lane = leastUrgent();
+            evict(lanes[lane].head);
+            unlink(lane, lanes[lane].head);
+        }
+    }
+
+    void setDropPolicy(MqttDropPolicy newPolicy) { policy = newPolicy; }
+    MqttDropPolicy dropPolicy() const { return policy; }
+
+    // How lanes are drained; the weights (0 counts as 1) are messages per WEIGHTED round
+    void setSchedule(MqttPrioritySchedule newSchedule, uint8_t urgentWeight, uint8_t normalWeight,
+                     uint8_t bulkWeight) {
+        const uint8_t weights[LANES] = {urgentWeight, normalWeight, bulkWeight};
+        schedule = newSchedule;
+        for (size_t i = 0; i < LANES; i++) {
+            lanes[i].weight = weights[i] ? weights[i] : 1;
+            lanes[i].credit = lanes[i].weight;
+        }
+    }
+
+    /*
+     * Copy a message to the back of its lane, or over the queued message with the same key.
+     * Returns false if the message was not queued.
+     */
+    bool push(const char *topic, const char *payload, size_t length, const MqttPublishOptions &options,
+              uint32_t id, uint16_t key = NO_KEY) {
+        if (capacity == 0 || !Message::fits(topic, length)) {
+            dropped++;
+            return false;
+        }
+
+        size_t lane = laneOf(options.priority);
+        if (key < Keys && latest[key] != NO_SLOT) {
+            uint16_t slot = latest[key];
+            Message &queued = slots[slot];
+            replaced++;
+            if (dropHandler) {
+                dropHandler(queued, dropContext);
+            }
+            size_t queuedLane = laneOf(queued.options.priority);
+            if (queuedLane == lane) {
+                queued.assign(topic, payload, length, options, id); // Keeps its place in the queue
+                return true;
+            }
+            unlink(queuedLane, slot); // Joins the back of its new lane below
+        }
+
+        if (count == capacity && !makeRoom(lane, false)) {
+            dropped++;
+            return false;
+        }
+
+        uint16_t slot = take();
+        slots[slot].assign(topic, payload, length, options, id);
+        prev[slot] = lanes[lane].tail;
+        if (lanes[lane].tail == NO_SLOT) {
+            lanes[lane].head = slot;
+        } else {
+            next[lanes[lane].tail] = slot;
+        }
+        lanes[lane].tail = slot;
+        lanes[lane].count++;
+        count++;
+        if (key < Keys) {
+            keyOf[slot] = key;
+            latest[key] = slot;
+        }
+        return true;
+    }
+
+    /*
+     * Put a message back at the front of its lane, e.g. one that was sent but
+     * never acknowledged. It is older than everything queued in that lane, so
+     * when the outbox is full DROP_OLDEST discards it and DROP_NEWEST evicts
+     * the back instead (less urgent lanes give way first, as for push()).
+     */
+    bool pushFront(const Message &message) {
+        size_t lane = laneOf(message.options.priority);
+        if (capacity == 0 || (count == capacity && !makeRoom(lane, true))) {
+            dropped++;
+            return false;
+        }
+        uint16_t slot = take();
+        slots[slot] = message; // Older than a queued message with its key, so it has none
+        next[slot] = lanes[lane].head;
+        prev[slot] = NO_SLOT;
+        if (lanes[lane].tail == NO_SLOT) {
+            lanes[lane].tail = slot;
+        } else {
+            prev[lanes[lane].head] = slot;
+        }
+        lanes[lane].head = slot;
+        lanes[lane].count++;
+        count++;
+        return true;
+    }
+
+    // Oldest message of the lane the schedule picks next, or nullptr when empty
+    const Message *front() const { return count ? &slots[lanes[nextLane()].head] : nullptr; }
+
+    /*
+     * Like front(), but skipping messages for which ready(message) is false: the oldest ready
+     * message of the first lane in schedule order that has one, or nullptr.
+     */
+    template <typename Ready>
+    const Message *front(Ready ready) const {
+        for (size_t pass = 0; pass < 2; pass++) { // WEIGHTED: lanes with credit left come first
+            for (size_t i = 0; i < LANES; i++) {
+                bool turn = schedule == MqttPrioritySchedule::STRICT || lanes[i].credit;
+                if (turn == (pass == 0)) {
+                    for (uint16_t slot = lanes[i].head; slot != NO_SLOT; slot = next[slot]) {
+                        if (ready(slots[slot])) {
+                            return &slots[slot];
+                        }
+                    }
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    // Newest message with this topic queued at this priority, or nullptr
+    Message *findLast(const char *topic, MqttPriority priority) {
+        Message *found = nullptr;
+        for (uint16_t slot = lanes[laneOf(priority)].head; slot != NO_SLOT; slot = next[slot]) {
+            if (strcmp(slots[slot].topic, topic) == 0) {
+                found = &slots[slot];
+            }
+        }
+        return found;
+    }
+
+    // Remove the message front() returned
+    void pop() {
+        if (count) {
+            pop(&slots[lanes[nextLane()].head]);
+        }
+    }
+
+    // Remove a queued message, e.g. one front(ready) returned; it counts as its lane's turn
+    void pop(const Message *message) {
+        uint16_t slot = (uint16_t)(message - slots);
+        size_t lane = laneOf(message->options.priority);
+        if (schedule == MqttPrioritySchedule::WEIGHTED) {
+            if (lanes[lane].credit == 0) {
+                for (size_t i = 0; i < LANES; i++) {
+                    lanes[i].credit = lanes[i].weight; // Every lane with a ready message had its turn: next round
+                }
+            }
+            lanes[lane].credit--;
+        }
+        unlink(lane, slot);
+    }
+
+    // Drop the oldest queued message with this topic and priority (reported to the drop handler); false if none
+    bool evictOldest(const char *topic, MqttPriority priority) {
+        size_t lane = laneOf(priority);
+        for (uint16_t slot = lanes[lane].head; slot != NO_SLOT; slot = next[slot]) {
+            if (strcmp(slots[slot].topic, topic) == 0) {
+                evict(slot);
+                unlink(lane, slot);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void clear() {
+        count = 0;
+        for (size_t i = 0; i < LANES; i++) {
+            lanes[i].head = NO_SLOT;
+            lanes[i].tail = NO_SLOT;
+            lanes[i].count = 0;
+        }
+        freeHead = NO_SLOT;
+        for (size_t i = Capacity; i-- > 0;) {
+            next[i] = freeHead;
+            freeHead = (uint16_t)i;
+            keyOf[i] = NO_KEY;
+        }
+        for (size_t i = 0; i < (Keys ? Keys : 1); i++) {
+            latest[i] = NO_SLOT;
+        }
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count >= capacity; }
+
+    // Whether a new message of this priority would have to wait for queued ones that ready(message) accepts
+    template <typename Ready>
+    bool waiting(MqttPriority priority, Ready ready) const {
+        for (size_t i = 0; i <= laneOf(priority); i++) {
+            for (uint16_t slot = lanes[i].head; slot != NO_SLOT; slot = next[slot]) {
+                if (ready(slots[slot])) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    unsigned long droppedCount() const { return dropped; }
+    unsigned long replacedCount() const { return replaced; } // Messages overwritten by a newer one with their key
+
+private:
+    static const uint16_t NO_SLOT = 0xFFFF;
+
+    struct Lane {
+        uint16_t head;  // Oldest message, or NO_SLOT
+        uint16_t tail;  // Newest message, or NO_SLOT
+        size_t count;
+        uint8_t weight; // Messages per WEIGHTED round
+        uint8_t credit; // ... left in the current round
+    };
+
+    Message slots[Capacity]; // Preallocated message storage
+    uint16_t next[Capacity]; // Per slot: next slot of its lane, or of the free list
+    uint16_t prev[Capacity]; // Per slot: previous slot of its lane, so any slot unlinks in O(1)
+    uint16_t keyOf[Capacity]; // Per slot: key of its message, or NO_KEY
+    uint16_t latest[Keys ? Keys : 1]; // Per key: slot of its queued message, or NO_SLOT
+    Lane lanes[LANES];       // Indexed by MqttPriority
+    uint16_t freeHead;       // First unused slot
+    size_t count;            // Number of queued messages
+    size_t capacity;         // Usable depth (<= Capacity)
+    MqttDropPolicy policy;   // Overflow behavior
+    MqttPrioritySchedule schedule;
+    unsigned long dropped;   // Messages discarded because of overflow or size limits
+    unsigned long replaced;  // Messages overwritten by a newer one with the same key
+    DropHandler dropHandler; // Notified of evicted messages
+    void *dropContext;
+
+    static size_t laneOf(MqttPriority priority) {
+        size_t lane = (size_t)priority;
+        return lane < LANES ? lane : LANES - 1;
+    }
+
+    // Most urgent non-empty lane with credit left in this round (any non-empty lane once none has)
+    size_t nextLane() const {
+        size_t first = LANES;
+        for (size_t i = 0; i < LANES; i++) {
+            if (lanes[i].count) {
+                if (schedule == MqttPrioritySchedule::STRICT || lanes[i].credit) {
+                    return i;
+                }
+                if (first == LANES) {
+                    first = i;
+                }
+            }
+        }
+        return first;
+    }
+
+    // Least urgent non-empty lane; only called when count > 0
+    size_t leastUrgent() const {
+        size_t lane = LANES - 1;
+        while (lanes[lane].count == 0) {
+            lane--;
+        }
+        return lane;
+    }
+
+    /*
+     * Evict one message for a newcomer to lane (to its front when atFront). A less urgent
+     * lane always gives way and a more urgent one never does; within the same lane the
+     * drop policy decides. False when the newcomer is the one to go.
+     */
+    bool makeRoom(size_t lane, bool atFront) {
+        size_t victim = leastUrgent();
+        bool oldest = policy == MqttDropPolicy::DROP_OLDEST;
+        if (victim < lane || (victim == lane && oldest == atFront)) {
+            return false;
+        }
+        uint16_t slot = oldest ? lanes[victim].head : lanes[victim].tail;
+        evict(slot);
+        unlink(victim, slot);
+        return true;
+    }
+
+    // A free slot; only called when count < capacity
+    uint16_t take() {
+        uint16_t slot = freeHead;
+        freeHead = next[slot];
+        next[slot] = NO_SLOT;
+        return slot;
+    }
+
+    // Take slot out of lane and free it
+    void unlink(size_t lane, uint16_t slot) {
+        uint16_t previous = prev[slot];
+        if (previous == NO_SLOT) {
+            lanes[lane].head = next[slot];
+        } else {
+            next[previous] = next[slot];
+        }
+        if (next[slot] == NO_SLOT) {
+            lanes[lane].tail = previous;
+        } else {
+            prev[next[slot]] = previous;
+        }
+        lanes[lane].count--;
+        count--;
+        uint16_t key = keyOf[slot];
+        if (key < Keys && latest[key] == slot) {
+            latest[key] = NO_SLOT;
+        }
+        keyOf[slot] = NO_KEY;
+        next[slot] = freeHead;
+        freeHead = slot;
+    }
+
+    void evict(uint16_t slot) {
+        dropped++;
+        if (dropHandler) {
+            dropHandler(slots[slot], dropContext);
+        }
+    }
+};
+
+#endif // MQTTOUTBOX_H
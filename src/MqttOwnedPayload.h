@@ -0,0 +1,53 @@
+#ifndef MQTTOWNEDPAYLOAD_H
+#define MQTTOWNEDPAYLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <utility>
+#include "MqttPayloadPool.h"
+
+/*
+ * A payload whose buffer the manager owns: heap bytes given up by the caller
+ * as a std::unique_ptr<uint8_t[]>, or a block leased from the payload pool.
+ *
+ * It is moved, never copied, from the caller into the publish queue and from
+ * there to the client, and frees (or returns) its buffer when it is reset or
+ * destroyed, on whichever task that happens.
+ */
+class MqttOwnedPayload {
+public:
+    MqttOwnedPayload() : bytes(0) {}
+    MqttOwnedPayload(std::unique_ptr<uint8_t[]> data, size_t length) : heap(std::move(data)), bytes(length) {}
+    explicit MqttOwnedPayload(MqttPayloadLease &&lease) : lease(std::move(lease)), bytes(this->lease.length()) {}
+    MqttOwnedPayload(MqttOwnedPayload &&other)
+        : heap(std::move(other.heap)), lease(std::move(other.lease)), bytes(other.bytes) {
+        other.bytes = 0;
+    }
+    MqttOwnedPayload &operator=(MqttOwnedPayload &&other) {
+        heap = std::move(other.heap);
+        lease = std::move(other.lease);
+        bytes = other.bytes;
+        other.bytes = 0;
+        return *this;
+    }
+
+    // Whether there is a buffer (a payload of length 0 still has one)
+    explicit operator bool() const { return heap || lease; }
+    const uint8_t *data() const { return heap ? heap.get() : lease.data(); }
+    size_t length() const { return bytes; }
+
+    // Free or return the buffer now
+    void reset() {
+        heap.reset();
+        lease.release();
+        bytes = 0;
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> heap;
+    MqttPayloadLease lease;
+    size_t bytes;
+};
+
+#endif // MQTTOWNEDPAYLOAD_H
@@ -0,0 +1,178 @@
+#ifndef MQTTPAYLOADPOOL_H
+#define MQTTPAYLOADPOOL_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include "MqttBufferPool.h"
+
+/*
+ * A payload buffer leased from an MqttPayloadPool.
+ *
+ * The caller fills it in place (append(), appendf() or data() + setLength())
+ * and moves it into sendMessage()/queueMessage(), which return the block to
+ * its pool. A lease can be moved but not copied; one that goes out of scope
+ * unsent releases its block too. An empty lease (the pool had no free block
+ * large enough) has no data and a capacity of 0.
+ */
+class MqttPayloadLease {
+public:
+    typedef void (*Release)(uint8_t *data, void *pool);
+
+    MqttPayloadLease() : bytes(nullptr), size(0), used(0), releaseBlock(nullptr), pool(nullptr) {}
+    MqttPayloadLease(uint8_t *data, size_t capacity, Release release, void *pool)
+        : bytes(data), size(capacity), used(0), releaseBlock(release), pool(pool) {}
+    MqttPayloadLease(MqttPayloadLease &&other)
+        : bytes(other.bytes), size(other.size), used(other.used), releaseBlock(other.releaseBlock), pool(other.pool) {
+        other.forget();
+    }
+    MqttPayloadLease &operator=(MqttPayloadLease &&other) {
+        if (this != &other) {
+            release();
+            bytes = other.bytes;
+            size = other.size;
+            used = other.used;
+            releaseBlock = other.releaseBlock;
+            pool = other.pool;
+            other.forget();
+        }
+        return *this;
+    }
+    MqttPayloadLease(const MqttPayloadLease &) = delete;
+    MqttPayloadLease &operator=(const MqttPayloadLease &) = delete;
+    ~MqttPayloadLease() { release(); }
+
+    explicit operator bool() const { return bytes != nullptr; }
+    uint8_t *data() { return bytes; }
+    const uint8_t *data() const { return bytes; }
+    size_t capacity() const { return size; }
+    size_t length() const { return used; }
+
+    // Payload length after writing through data(); false if it exceeds the capacity
+    bool setLength(size_t length) {
+        if (length > size) {
+            return false;
+        }
+        used = length;
+        return true;
+    }
+
+    // Add bytes at the end; false (and nothing added) if they do not fit
+    bool append(const void *data, size_t length) {
+        if (length > size - used) {
+            return false;
+        }
+        memcpy(bytes + used, data, length);
+        used += length;
+        return true;
+    }
+
+    // Add formatted text at the end; needs one spare byte for the terminator, which is not counted
+    bool appendf(const char *format, ...) {
+        if (used == size) {
+            return false;
+        }
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf((char *)bytes + used, size - used, format, args);
+        va_end(args);
+        if (written < 0 || (size_t)written >= size - used) {
+            bytes[used] = '\0';
+            return false;
+        }
+        used += written;
+        return true;
+    }
+
+    void clear() { used = 0; }
+
+    // Give the block back now
+    void release() {
+        if (bytes) {
+            releaseBlock(bytes, pool);
+            forget();
+        }
+    }
+
+private:
+    uint8_t *bytes;
+    size_t size;
+    size_t used;
+    Release releaseBlock;
+    void *pool;
+
+    void forget() {
+        bytes = nullptr;
+        size = 0;
+        used = 0;
+    }
+};
+
+/*
+ * Payload buffers in three size classes, each a fixed MqttBufferPool.
+ *
+ * lease() takes a block from the smallest class that is large enough and
+ * falls back to larger classes when that one is used up. Blocks are leased
+ * and released with atomic flags only, so any task may lease a buffer and
+ * any task may let it go; nothing is allocated after construction.
+ */
+template <size_t SmallSize, size_t SmallCount, size_t MediumSize, size_t MediumCount, size_t LargeSize,
+          size_t LargeCount>
+class MqttPayloadPool {
+public:
+    MqttPayloadPool() : failures(0) {}
+
+    // A buffer of at least capacity bytes, or an empty lease when none is free
+    MqttPayloadLease lease(size_t capacity) {
+        if (capacity <= SmallSize) {
+            if (SmallBlock *block = small.acquire()) {
+                return MqttPayloadLease(block->bytes, SmallSize, release, this);
+            }
+        }
+        if (capacity <= MediumSize) {
+            if (MediumBlock *block = medium.acquire()) {
+                return MqttPayloadLease(block->bytes, MediumSize, release, this);
+            }
+        }
+        if (capacity <= LargeSize) {
+            if (LargeBlock *block = large.acquire()) {
+                return MqttPayloadLease(block->bytes, LargeSize, release, this);
+            }
+        }
+        failures.fetch_add(1, std::memory_order_relaxed);
+        return MqttPayloadLease();
+    }
+
+    size_t available() const { return small.available() + medium.available() + large.available(); }
+    unsigned long exhausted() const { return failures.load(std::memory_order_relaxed); } // lease() calls that failed
+
+private:
+    template <size_t Size>
+    struct Block {
+        uint8_t bytes[Size];
+    };
+    typedef Block<SmallSize> SmallBlock;
+    typedef Block<MediumSize> MediumBlock;
+    typedef Block<LargeSize> LargeBlock;
+
+    MqttBufferPool<SmallBlock, SmallCount> small;
+    MqttBufferPool<MediumBlock, MediumCount> medium;
+    MqttBufferPool<LargeBlock, LargeCount> large;
+    std::atomic<unsigned long> failures;
+
+    static void release(uint8_t *data, void *pool) {
+        MqttPayloadPool *self = (MqttPayloadPool *)pool;
+        if (self->small.owns((SmallBlock *)data)) {
+            self->small.release((SmallBlock *)data);
+        } else if (self->medium.owns((MediumBlock *)data)) {
+            self->medium.release((MediumBlock *)data);
+        } else {
+            self->large.release((LargeBlock *)data);
+        }
+    }
+};
+
+#endif // MQTTPAYLOADPOOL_H
@@ -0,0 +1,101 @@
+#ifndef MQTTPUBLISHBATCH_H
+#define MQTTPUBLISHBATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "MqttMessage.h"
+
+/*
+ * QoS 0 PUBLISH packets encoded back to back into one fixed buffer of Bytes
+ * bytes, for up to Messages messages, so that a whole batch can go out in a
+ * single write. Each message also keeps its handle id and options (for the
+ * completion callback) and where its topic and payload are, so the batch can
+ * be replayed message by message when a single write is not possible.
+ * Bytes and Messages of 0 turn batching off: nothing fits, so every message
+ * is published on its own.
+ */
+template <size_t Bytes, size_t Messages>
+class MqttPublishBatch {
+    static_assert((Bytes == 0 && Messages == 0) || (Bytes >= 8 && Bytes <= 0xFFFF && Messages > 0),
+                  "MqttPublishBatch must hold 8 to 65535 bytes, or be sized 0 to turn batching off");
+
+public:
+    struct Entry {
+        uint32_t id;                // MqttPublishHandle::id
+        MqttPublishOptions options;
+        uint16_t topic;             // Offset of the topic in data()
+        uint16_t topicLength;
+        uint16_t payload;           // Offset of the payload in data()
+        uint16_t length;            // Payload length
+    };
+
+    MqttPublishBatch() : used(0), count(0), startedAt(0) {}
+
+    // Bytes one message takes in the batch
+    static size_t packetSize(size_t topicLength, size_t length) {
+        size_t remaining = 2 + topicLength + length;
+        size_t lengthBytes = remaining < 128 ? 1 : remaining < 16384 ? 2 : remaining < 2097152 ? 3 : 4;
+        return 1 + lengthBytes + remaining;
+    }
+
+    // Whether a message this large could ever be batched
+    static bool fits(size_t topicLength, size_t length) {
+        return packetSize(topicLength, length) <= Bytes;
+    }
+
+    // Encode a QoS 0 PUBLISH at the end; false when the batch has no room left for it
+    bool add(const char *topic, size_t topicLength, const char *payload, size_t length,
+             const MqttPublishOptions &options, uint32_t id, unsigned long now) {
+        size_t size = packetSize(topicLength, length);
+        if (count == Messages || size > Bytes - used) {
+            return false;
+        }
+        if (count == 0) {
+            startedAt = now;
+        }
+        uint8_t *out = buffer + used;
+        *out++ = 0x30 | (options.retain ? 0x01 : 0x00); // PUBLISH, QoS 0
+        size_t remaining = 2 + topicLength + length;
+        do {
+            uint8_t digit = remaining % 128;
+            remaining /= 128;
+            *out++ = remaining > 0 ? (digit | 0x80) : digit;
+        } while (remaining > 0);
+        *out++ = (uint8_t)(topicLength >> 8);
+        *out++ = (uint8_t)(topicLength & 0xFF);
+        Entry &entry = entries[count++];
+        entry.id = id;
+        entry.options = options;
+        entry.topic = (uint16_t)(out - buffer);
+        entry.topicLength = (uint16_t)topicLength;
+        memcpy(out, topic, topicLength);
+        out += topicLength;
+        entry.payload = (uint16_t)(out - buffer);
+        entry.length = (uint16_t)length;
+        memcpy(out, payload, length);
+        used += size;
+        return true;
+    }
+
+    const uint8_t *data() const { return buffer; }
+    size_t size() const { return used; }
+    size_t messages() const { return count; }
+    bool empty() const { return count == 0; }
+    const Entry &at(size_t index) const { return entries[index]; }
+    unsigned long since() const { return startedAt; } // Clock time of the first message
+
+    void clear() {
+        used = 0;
+        count = 0;
+    }
+
+private:
+    uint8_t buffer[Bytes ? Bytes : 1]; // Zero-length arrays are not C++
+    size_t used;
+    Entry entries[Messages ? Messages : 1];
+    size_t count;
+    unsigned long startedAt;
+};
+
+#endif // MQTTPUBLISHBATCH_H
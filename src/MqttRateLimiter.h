@@ -0,0 +1,67 @@
+#ifndef MQTTRATELIMITER_H
+#define MQTTRATELIMITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// What happens to a message published while its token bucket is empty
+enum class MqttRateLimitPolicy : uint8_t {
+    QUEUE,    // Wait in the outbox until tokens are available (keeps every message)
+    COALESCE, // Replace the newest queued message of the same topic, or queue when there is none
+    DROP      // Discard it (reported DROPPED)
+};
+
+// How often limiting kicked in, by outcome
+struct MqttRateLimitStats {
+    unsigned long queued;    // Held back in the outbox
+    unsigned long coalesced; // Replaced an older queued message of the same topic
+    unsigned long dropped;   // Discarded
+};
+
+/*
+ * Token bucket: refills at ratePerSecond tokens per second up to burst
+ * tokens, and every publish takes one. Tokens are counted in thousandths, so
+ * each elapsed millisecond adds ratePerSecond of them without floating point;
+ * time comes from the manager's MqttClock. A rate of 0 means unlimited, so the
+ * slowest limit is one message per second.
+ */
+class MqttTokenBucket {
+public:
+    MqttTokenBucket() : rate(0), capacity(0), milliTokens(0), refilledAt(0) {}
+
+    void configure(unsigned long ratePerSecond, unsigned long burst, unsigned long now) {
+        rate = ratePerSecond;
+        capacity = (burst ? burst : 1) * 1000UL;
+        milliTokens = capacity; // Start full: a burst is allowed right away
+        refilledAt = now;
+    }
+
+    bool limited() const { return rate != 0; }
+
+    // Whether a token is available now (does not take it)
+    bool ready(unsigned long now) {
+        if (!rate) {
+            return true;
+        }
+        unsigned long elapsed = now - refilledAt;
+        refilledAt = now;
+        unsigned long added = elapsed >= capacity / rate + 1 ? capacity : elapsed * rate; // No overflow on long idles
+        milliTokens = capacity - milliTokens < added ? capacity : milliTokens + added;
+        return milliTokens >= 1000;
+    }
+
+    // Take one token; call after ready() returned true
+    void take() {
+        if (rate) {
+            milliTokens -= 1000;
+        }
+    }
+
+private:
+    unsigned long rate;        // Tokens per second, 0 = unlimited
+    unsigned long capacity;    // Burst in thousandths of a token
+    unsigned long milliTokens; // Current fill in thousandths of a token
+    unsigned long refilledAt;  // Clock time of the last refill
+};
+
+#endif // MQTTRATELIMITER_H
@@ -0,0 +1,170 @@
+#ifndef MQTTRESOLVER_H
+#define MQTTRESOLVER_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <stdint.h>
+#include <atomic>
+#if defined(ARDUINO_ARCH_ESP32)
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+#elif defined(ARDUINO_HOST_SHIM)
+#include <WiFi.h>
+#include <string>
+#include <thread>
+#endif
+
+// Progress of the lookup MqttResolver::begin() started
+enum class MqttLookupStatus : uint8_t {
+    PENDING,  // Still waiting for the answer
+    RESOLVED, // address holds the answer
+    FAILED    // No answer; the name does not exist or the DNS server did not reply
+};
+
+/*
+ * Host name lookup used by MqttManager for brokers given by name.
+ *
+ * Lookups are asynchronous: begin() only starts one and must not block, and
+ * the manager polls status() from the task that publishes (loop() or the
+ * publisher task), keeping a cached address in use meanwhile. One lookup runs
+ * at a time, and host stays valid until it has finished. MqttManager caches
+ * the answers, so this is only called on the first connect and when a cached
+ * address expires or stops working.
+ */
+class MqttResolver {
+public:
+    virtual ~MqttResolver() {}
+    virtual bool begin(const char *host) = 0; // Start a lookup; false when none could be started
+    virtual MqttLookupStatus status(IPAddress &address) = 0; // Of the last lookup; address set when RESOLVED
+};
+
+#if defined(ARDUINO_ARCH_ESP32)
+/*
+ * lwIP's own asynchronous DNS client. The query is started on the tcpip
+ * thread (tcpip_callback()), where lwIP also reports the answer, so neither
+ * the caller nor the network task ever waits for the DNS server.
+ */
+class LwipResolver : public MqttResolver {
+public:
+    LwipResolver() : host(nullptr), resolved(0), state(MqttLookupStatus::FAILED) {}
+
+    bool begin(const char *host) override {
+        if (state.load() == MqttLookupStatus::PENDING) {
+            return false;
+        }
+        this->host = host;
+        state.store(MqttLookupStatus::PENDING);
+        if (tcpip_callback(start, this) != ERR_OK) {
+            state.store(MqttLookupStatus::FAILED);
+            return false;
+        }
+        return true;
+    }
+
+    MqttLookupStatus status(IPAddress &address) override {
+        MqttLookupStatus current = state.load();
+        if (current == MqttLookupStatus::RESOLVED) {
+            address = IPAddress(resolved.load());
+        }
+        return current;
+    }
+
+private:
+    const char *host;
+    std::atomic<uint32_t> resolved; // IPv4 address in network byte order
+    std::atomic<MqttLookupStatus> state;
+
+    // On the tcpip thread
+    static void start(void *context) {
+        LwipResolver *self = (LwipResolver *)context;
+        ip_addr_t address;
+        err_t result = dns_gethostbyname(self->host, &address, found, self);
+        if (result == ERR_OK) {
+            self->finish(&address); // Answered from lwIP's own cache
+        } else if (result != ERR_INPROGRESS) {
+            self->finish(nullptr);
+        }
+    }
+
+    static void found(const char *name, const ip_addr_t *address, void *context) {
+        (void)name;
+        ((LwipResolver *)context)->finish(address);
+    }
+
+    void finish(const ip_addr_t *address) {
+        if (address && IP_IS_V4(address)) {
+            resolved.store(ip4_addr_get_u32(ip_2_ip4(address)));
+            state.store(MqttLookupStatus::RESOLVED);
+        } else {
+            state.store(MqttLookupStatus::FAILED);
+        }
+    }
+};
+
+typedef LwipResolver MqttDefaultResolver;
+#elif defined(ARDUINO_HOST_SHIM)
+// Host: the blocking WiFi.hostByName() of the shim (getaddrinfo()) on a thread of its own
+class ThreadResolver : public MqttResolver {
+public:
+    ThreadResolver() : state(MqttLookupStatus::FAILED) {}
+    ~ThreadResolver() { join(); }
+
+    bool begin(const char *host) override {
+        if (state.load() == MqttLookupStatus::PENDING) {
+            return false;
+        }
+        join();
+        state.store(MqttLookupStatus::PENDING);
+        std::string name(host);
+        worker = std::thread([this, name]() {
+            IPAddress answer;
+            if (WiFi.hostByName(name.c_str(), answer) == 1) {
+                address = answer; // Published by the store below
+                state.store(MqttLookupStatus::RESOLVED);
+            } else {
+                state.store(MqttLookupStatus::FAILED);
+            }
+        });
+        return true;
+    }
+
+    MqttLookupStatus status(IPAddress &address) override {
+        MqttLookupStatus current = state.load();
+        if (current == MqttLookupStatus::RESOLVED) {
+            address = this->address;
+        }
+        return current;
+    }
+
+private:
+    std::thread worker;
+    IPAddress address;
+    std::atomic<MqttLookupStatus> state;
+
+    void join() {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+};
+
+typedef ThreadResolver MqttDefaultResolver;
+#else
+// No asynchronous DNS on this core: brokers given by name need setResolver()
+class NoResolver : public MqttResolver {
+public:
+    bool begin(const char *host) override {
+        (void)host;
+        return false;
+    }
+
+    MqttLookupStatus status(IPAddress &address) override {
+        (void)address;
+        return MqttLookupStatus::FAILED;
+    }
+};
+
+typedef NoResolver MqttDefaultResolver;
+#endif
+
+#endif // MQTTRESOLVER_H
@@ -0,0 +1,178 @@
+#ifndef MQTTSERVERLIST_H
+#define MQTTSERVERLIST_H
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Brokers MqttManager can connect to, with a health record for each.
+ *
+ * Servers are grouped by priority (lower is preferred). select() returns the
+ * healthy server of the best priority and, within a priority, the fastest one
+ * by measured round-trip time (or connect time until an RTT is known). A
+ * failed attempt puts a server in quarantine for a period that doubles with
+ * every consecutive failure, so a dead primary is retried ever less often and
+ * its backups carry the traffic meanwhile. Everything is stored inline.
+ *
+ * Hosts may be IPv4 literals or names. Each server also caches the address its
+ * name last resolved to; MqttManager decides when that cache is fresh.
+ */
+template <size_t Capacity, size_t MaxHostLen>
+class MqttServerList {
+    static_assert(Capacity > 0, "MqttServerList needs at least one slot");
+
+public:
+    enum AddressState : uint8_t {
+        UNRESOLVED, // Name not looked up yet
+        RESOLVED,   // address holds the last lookup result
+        LITERAL     // host is an IP address; never looked up
+    };
+
+    struct Server {
+        char host[MaxHostLen];     // Host name or IPv4 literal
+        uint16_t port;
+        uint8_t priority;          // Lower is preferred
+        uint8_t failures;          // Consecutive failed connect attempts
+        unsigned long failedAt;    // Clock time of the last failure
+        unsigned long connectTime; // Smoothed connect() to CONNACK time in ms, 0 = unknown
+        unsigned long rtt;         // Smoothed publish-to-acknowledgement time in ms, 0 = unknown
+        IPAddress address;         // Literal, or cached lookup result
+        AddressState addressState;
+        unsigned long resolvedAt;  // Clock time of the lookup
+        bool revalidate;           // Look the name up again before the next connect
+    };
+
+    MqttServerList() : count(0), quarantineBase(5000), quarantineMax(300000) {}
+
+    void clear() { count = 0; }
+
+    // Returns false when the list is full or the host does not fit
+    bool add(const char *host, uint16_t port, uint8_t priority) {
+        if (count == Capacity || strlen(host) >= sizeof(servers[0].host)) {
+            return false;
+        }
+        Server &server = servers[count++];
+        strcpy(server.host, host);
+        server.port = port;
+        server.priority = priority;
+        server.failures = 0;
+        server.failedAt = 0;
+        server.connectTime = 0;
+        server.rtt = 0;
+        server.addressState = server.address.fromString(host) ? LITERAL : UNRESOLVED;
+        server.resolvedAt = 0;
+        server.revalidate = false;
+        return true;
+    }
+
+    // Quarantine after the first failure and its upper bound
+    void setQuarantine(unsigned long baseMs, unsigned long maxMs) {
+        quarantineBase = baseMs;
+        quarantineMax = maxMs;
+    }
+
+    size_t size() const { return count; }
+    const Server &at(size_t index) const { return servers[index]; }
+    Server &at(size_t index) { return servers[index]; }
+
+    // Whether a server may be tried now
+    bool healthy(size_t index, unsigned long now) const {
+        const Server &server = servers[index];
+        return server.failures == 0 || now - server.failedAt >= quarantine(server);
+    }
+
+    /*
+     * Server to connect to next: the best healthy one, or when every server is
+     * in quarantine the one whose quarantine ends first. Returns Capacity when
+     * the list is empty.
+     */
+    size_t select(unsigned long now) const {
+        size_t best = Capacity;
+        for (size_t i = 0; i < count; i++) {
+            if (healthy(i, now) && (best == Capacity || better(i, best))) {
+                best = i;
+            }
+        }
+        if (best != Capacity) {
+            return best;
+        }
+        unsigned long soonest = 0;
+        for (size_t i = 0; i < count; i++) {
+            unsigned long remaining = quarantine(servers[i]) - (now - servers[i].failedAt);
+            if (best == Capacity || remaining < soonest) {
+                best = i;
+                soonest = remaining;
+            }
+        }
+        return best;
+    }
+
+    // Whether a healthy server of a better priority than current exists (time to fail back)
+    bool preferredOver(size_t current, unsigned long now) const {
+        for (size_t i = 0; i < count; i++) {
+            if (servers[i].priority < servers[current].priority && healthy(i, now)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void recordSuccess(size_t index, unsigned long connectMs) {
+        Server &server = servers[index];
+        server.failures = 0;
+        server.connectTime = smooth(server.connectTime, connectMs);
+    }
+
+    void recordFailure(size_t index, unsigned long now) {
+        Server &server = servers[index];
+        if (server.failures < 255) {
+            server.failures++;
+        }
+        server.failedAt = now;
+    }
+
+    void recordRtt(size_t index, unsigned long rttMs) {
+        servers[index].rtt = smooth(servers[index].rtt, rttMs);
+    }
+
+private:
+    Server servers[Capacity];
+    size_t count;
+    unsigned long quarantineBase;
+    unsigned long quarantineMax;
+
+    unsigned long quarantine(const Server &server) const {
+        if (server.failures == 0) {
+            return 0;
+        }
+        unsigned long period = quarantineBase;
+        for (uint8_t i = 1; i < server.failures && period < quarantineMax; i++) {
+            period *= 2;
+        }
+        return period < quarantineMax ? period : quarantineMax;
+    }
+
+    // Latency used to rank servers of the same priority; unknown (0) ranks first so it gets measured
+    static unsigned long latency(const Server &server) {
+        return server.rtt ? server.rtt : server.connectTime;
+    }
+
+    bool better(size_t a, size_t b) const {
+        if (servers[a].priority != servers[b].priority) {
+            return servers[a].priority < servers[b].priority;
+        }
+        return latency(servers[a]) < latency(servers[b]);
+    }
+
+    // Exponentially weighted moving average with alpha 1/4; a 0 sample still counts as "measured"
+    static unsigned long smooth(unsigned long average, unsigned long sample) {
+        if (sample == 0) {
+            sample = 1;
+        }
+        return average ? (average * 3 + sample) / 4 : sample;
+    }
+};
+
+#endif // MQTTSERVERLIST_H
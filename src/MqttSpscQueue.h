@@ -0,0 +1,59 @@
+#ifndef MQTTSPSCQUEUE_H
+#define MQTTSPSCQUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+
+/*
+ * Lock-free single-producer/single-consumer ring of Capacity items.
+ *
+ * Exactly one task may push() and exactly one (other) task may pop(). Each
+ * side owns one index and only reads the other's, so an operation is a copy
+ * plus one acquire load and one release store: no locks, no allocation and
+ * nothing that can block the producer. Capacity must be a power of two; one
+ * slot is kept free to tell a full ring from an empty one.
+ */
+template <typename T, size_t Capacity>
+class MqttSpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "MqttSpscQueue capacity must be a power of two");
+
+public:
+    MqttSpscQueue() : head(0), tail(0) {}
+
+    // Producer side. Returns false (and copies nothing) when the ring is full.
+    bool push(const T &item) {
+        size_t write = tail.load(std::memory_order_relaxed);
+        size_t next = (write + 1) & (Capacity - 1);
+        if (next == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        items[write] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false when the ring is empty.
+    bool pop(T &item) {
+        size_t read = head.load(std::memory_order_relaxed);
+        if (read == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items[read];
+        head.store((read + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called while the other side is active
+    size_t size() const {
+        return (tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire)) & (Capacity - 1);
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    T items[Capacity];
+    std::atomic<size_t> head; // Next slot to read; written by the consumer only
+    std::atomic<size_t> tail; // Next slot to write; written by the producer only
+};
+
+#endif // MQTTSPSCQUEUE_H
@@ -0,0 +1,189 @@
+#ifndef MQTTTASK_H
+#define MQTTTASK_H
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <atomic>
+#if !defined(ARDUINO_ARCH_ESP32) && defined(ARDUINO_HOST_SHIM)
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/*
+ * One background task running a function, pinned to a core.
+ *
+ * On the ESP32 this is a FreeRTOS task created with xTaskCreatePinnedToCore()
+ * at the given priority and stack size; wait()/notify() use direct task
+ * notifications. On the host (the shim in host/shim) it is a std::thread whose
+ * CPU affinity is set to the given core; priority and stack size are ignored
+ * there (raising thread priority needs privileges a development box does not
+ * have). Other cores have no tasks: start() fails, so the application keeps
+ * calling poll() and reconnect() from loop().
+ *
+ * The function runs until it returns; it should loop on stopRequested() and
+ * sleep in wait(), which notify() (from any task) or stop() cuts short.
+ */
+class MqttTask {
+public:
+    typedef void (*Function)(void *context);
+
+    static const int ANY_CORE = -1;
+
+    MqttTask() : function(nullptr), context(nullptr), started(false), stopping(false), finished(false) {
+#if defined(ARDUINO_ARCH_ESP32)
+        handle = nullptr;
+#elif defined(ARDUINO_HOST_SHIM)
+        notified = false;
+#endif
+    }
+
+    ~MqttTask() { stop(); }
+
+    // Start the task; false if it is already running or could not be created
+    bool start(const char *name, Function function, void *context, int core, unsigned priority, size_t stackSize) {
+        if (started.load()) {
+            return false;
+        }
+        this->function = function;
+        this->context = context;
+        stopping.store(false);
+        finished.store(false);
+#if defined(ARDUINO_ARCH_ESP32)
+        started.store(true); // Before the task exists: it may run (and check current()) at once
+        BaseType_t created = xTaskCreatePinnedToCore(entry, name, stackSize, this, priority, &handle,
+                                                     core == ANY_CORE ? tskNO_AFFINITY : core);
+        if (created != pdPASS) {
+            handle = nullptr;
+            started.store(false);
+            return false;
+        }
+#elif defined(ARDUINO_HOST_SHIM)
+        (void)name;
+        (void)priority;
+        (void)stackSize;
+        started.store(true);
+        thread = std::thread(entry, this);
+        if (core != ANY_CORE) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(core, &cpus);
+            pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus); // Best effort: core may not exist
+        }
+#else
+        (void)name;
+        (void)core;
+        (void)priority;
+        (void)stackSize;
+        return false; // No tasks on this core
+#endif
+        return true;
+    }
+
+    // Ask the task to finish and wait until it has
+    void stop() {
+        if (!started.load()) {
+            return;
+        }
+        stopping.store(true);
+        notify();
+#if defined(ARDUINO_ARCH_ESP32)
+        while (!finished.load()) {
+            vTaskDelay(1);
+        }
+        handle = nullptr;
+#elif defined(ARDUINO_HOST_SHIM)
+        if (thread.joinable()) {
+            thread.join();
+        }
+        id.store(std::thread::id());
+#endif
+        started.store(false);
+    }
+
+    bool running() const { return started.load(); }
+    bool stopRequested() const { return stopping.load(); }
+
+    // Whether the caller is this task
+    bool current() const {
+#if defined(ARDUINO_ARCH_ESP32)
+        return handle != nullptr && xTaskGetCurrentTaskHandle() == handle;
+#elif defined(ARDUINO_HOST_SHIM)
+        return std::this_thread::get_id() == id.load();
+#else
+        return false;
+#endif
+    }
+
+    // Wake the task if it is in wait(); safe from any task
+    void notify() {
+#if defined(ARDUINO_ARCH_ESP32)
+        if (handle) {
+            xTaskNotifyGive(handle);
+        }
+#elif defined(ARDUINO_HOST_SHIM)
+        if (!notified.exchange(true)) {
+            condition.notify_one(); // Without the lock: a wakeup racing wait() is caught by its timeout
+        }
+#endif
+    }
+
+    // From the task: sleep until notified or timeoutMs passed
+    void wait(unsigned long timeoutMs) {
+#if defined(ARDUINO_ARCH_ESP32)
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+#elif defined(ARDUINO_HOST_SHIM)
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return notified.load(); });
+        notified.store(false);
+#else
+        delay(timeoutMs);
+#endif
+    }
+
+    // From the task: let other ready tasks of the same priority run
+    void yield() {
+#if defined(ARDUINO_ARCH_ESP32)
+        taskYIELD();
+#elif defined(ARDUINO_HOST_SHIM)
+        std::this_thread::yield();
+#else
+        ::yield(); // Arduino's, which feeds the watchdog where there is one
+#endif
+    }
+
+private:
+    Function function;
+    void *context;
+    std::atomic<bool> started;
+    std::atomic<bool> stopping;
+    std::atomic<bool> finished;
+#if defined(ARDUINO_ARCH_ESP32)
+    TaskHandle_t handle;
+
+    static void entry(void *task) {
+        MqttTask *self = (MqttTask *)task;
+        self->handle = xTaskGetCurrentTaskHandle(); // May run before xTaskCreatePinnedToCore() stores it
+        self->function(self->context);
+        self->finished.store(true);
+        vTaskDelete(nullptr); // FreeRTOS tasks must not return
+    }
+#elif defined(ARDUINO_HOST_SHIM)
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::atomic<bool> notified;
+    std::atomic<std::thread::id> id; // Set by the thread itself, so current() works from its first instruction
+
+    static void entry(MqttTask *self) {
+        self->id.store(std::this_thread::get_id());
+        self->function(self->context);
+        self->finished.store(true);
+    }
+#endif
+};
+
+#endif // MQTTTASK_H
@@ -0,0 +1,155 @@
+#ifndef MQTTTOPICREGISTRY_H
+#define MQTTTOPICREGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "MqttMessage.h"
+
+// Handle of a topic registered with registerTopic(); two bytes, passed by value
+struct MqttTopic {
+    static const uint16_t NONE = 0xFFFF;
+
+    uint16_t index; // Slot in the registry, NONE if registration failed
+
+    MqttTopic() : index(NONE) {}
+    explicit MqttTopic(uint16_t index) : index(index) {}
+    bool valid() const { return index != NONE; }
+};
+
+/*
+ * Fixed table of Count topics declared once and then referred to by handle.
+ *
+ * add() expands {name} placeholders in a pattern with values set by
+ * setVariable(), so "korngva/{device}/first_floor/sound_state" is built once
+ * at startup instead of with snprintf() on every publish. Each entry keeps its
+ * length and the per-topic publish options that apply to it, so looking a
+ * topic up by handle is an array index. Register topics during setup: add()
+ * and setVariable() are not thread-safe, reading entries is.
+ */
+template <size_t Count, size_t MaxTopicLen, size_t MaxVariables, size_t MaxValueLen>
+class MqttTopicRegistry {
+    static_assert(Count < MqttTopic::NONE, "MqttTopicRegistry has too many slots");
+
+public:
+    static const size_t maxNameLen = 16; // Longest variable name, including the terminator
+
+    MqttTopicRegistry() : count(0), variableCount(0) {}
+
+    // Value substituted for {name}; false when the table is full or name/value too long
+    bool setVariable(const char *name, const char *value) {
+        if (strlen(name) >= maxNameLen || strlen(value) >= MaxValueLen) {
+            return false;
+        }
+        Variable *variable = findVariable(name, strlen(name));
+        if (!variable) {
+            if (variableCount == MaxVariables) {
+                return false;
+            }
+            variable = &variables[variableCount++];
+            strcpy(variable->name, name);
+        }
+        strcpy(variable->value, value);
+        return true;
+    }
+
+    // Expand and register pattern; an invalid handle if a variable is unknown, the topic too long or the table full
+    MqttTopic add(const char *pattern, const MqttPublishOptions *options) {
+        char topic[MaxTopicLen];
+        size_t length = expand(pattern, topic);
+        if (length == 0) {
+            return MqttTopic();
+        }
+        MqttTopic existing = find(topic);
+        if (existing.valid()) {
+            return existing;
+        }
+        if (count == Count) {
+            return MqttTopic();
+        }
+        Entry &entry = entries[count];
+        memcpy(entry.topic, topic, length + 1);
+        entry.length = length;
+        entry.options = options;
+        return MqttTopic((uint16_t)count++);
+    }
+
+    // Handle of an already registered topic, or an invalid one
+    MqttTopic find(const char *topic) const {
+        for (size_t i = 0; i < count; i++) {
+            if (strcmp(entries[i].topic, topic) == 0) {
+                return MqttTopic((uint16_t)i);
+            }
+        }
+        return MqttTopic();
+    }
+
+    bool contains(MqttTopic topic) const { return topic.index < count; }
+    const char *topic(MqttTopic topic) const { return entries[topic.index].topic; } // Caller checks contains()
+    size_t length(MqttTopic topic) const { return entries[topic.index].length; }
+    const MqttPublishOptions *options(MqttTopic topic) const { return entries[topic.index].options; } // nullptr: default
+
+    // Point a registered topic at its own publish options (nullptr for the default)
+    void setOptions(MqttTopic topic, const MqttPublishOptions *options) {
+        if (contains(topic)) {
+            entries[topic.index].options = options;
+        }
+    }
+
+    size_t size() const { return count; }
+
+private:
+    struct Entry {
+        char topic[MaxTopicLen];
+        size_t length;
+        const MqttPublishOptions *options;
+    };
+    struct Variable {
+        char name[maxNameLen];
+        char value[MaxValueLen];
+    };
+
+    Entry entries[Count];
+    size_t count;
+    Variable variables[MaxVariables];
+    size_t variableCount;
+
+    Variable *findVariable(const char *name, size_t length) {
+        for (size_t i = 0; i < variableCount; i++) {
+            if (strlen(variables[i].name) == length && strncmp(variables[i].name, name, length) == 0) {
+                return &variables[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // Pattern with its placeholders replaced; returns the length, or 0 on failure
+    size_t expand(const char *pattern, char *topic) {
+        size_t length = 0;
+        for (const char *p = pattern; *p;) {
+            const char *text = p;
+            size_t textLength = 1;
+            if (*p == '{') {
+                const char *end = strchr(p, '}');
+                Variable *variable = end ? findVariable(p + 1, end - p - 1) : nullptr;
+                if (!variable) {
+                    return 0;
+                }
+                text = variable->value;
+                textLength = strlen(text);
+                p = end + 1;
+            } else {
+                p++;
+            }
+            if (length + textLength >= MaxTopicLen) {
+                return 0;
+            }
+            memcpy(topic + length, text, textLength);
+            length += textLength;
+        }
+        topic[length] = '\0';
+        return length;
+    }
+};
+
+#endif // MQTTTOPICREGISTRY_H
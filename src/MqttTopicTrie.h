@@ -0,0 +1,313 @@
+#ifndef MQTTTOPICTRIE_H
+#define MQTTTOPICTRIE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "MqttMessage.h"
+
+/*
+ * Subscription registry: topic filters stored as a trie of topic levels, with
+ * the handlers registered for each filter.
+ *
+ * An incoming topic is matched by walking it one level at a time; at every
+ * level only the matching literal child and the '+' and '#' children are
+ * followed, so the cost grows with the number of levels in the topic (times
+ * the few children per node) rather than with the number of filters.
+ *
+ * Nodes and subscriptions come from fixed pools sized by the template
+ * parameters and are returned to them on unsubscribe.
+ *
+ * Per MQTT 3.1.1, '+' matches exactly one level, '#' matches any number of
+ * levels including none ("a/#" also matches "a"), and wildcards in the first
+ * level do not match topics starting with '$'. Handlers must not add or remove
+ * filters while a message is being dispatched.
+ */
+template <size_t MaxNodes, size_t MaxSubscriptions, size_t MaxLevelLen>
+class MqttTopicTrie {
+    static_assert(MaxNodes > 0 && MaxNodes < 0xFFFF, "MqttTopicTrie node pool size out of range");
+    static_assert(MaxSubscriptions > 0 && MaxSubscriptions < 0xFFFF, "MqttTopicTrie subscription pool size out of range");
+
+public:
+    static const uint16_t NONE = 0xFFFF;
+
+    MqttTopicTrie() { clear(); }
+
+    void clear() {
+        for (size_t i = 0; i < MaxNodes; i++) {
+            nodes[i].parent = NONE;
+            nodes[i].firstChild = NONE;
+            nodes[i].nextSibling = i + 1 < MaxNodes ? (uint16_t)(i + 1) : NONE; // Free list
+            nodes[i].subscriptions = NONE;
+        }
+        for (size_t i = 0; i < MaxSubscriptions; i++) {
+            subscriptions[i].next = i + 1 < MaxSubscriptions ? (uint16_t)(i + 1) : NONE;
+        }
+        freeNodes = 0;
+        freeSubscriptions = 0;
+        root = allocateNode(NONE, "", 0);
+    }
+
+    // Whether a filter is well formed: no empty topic, '#' only last, wildcards only as whole levels
+    static bool validFilter(const char *filter) {
+        if (!filter || !*filter) {
+            return false;
+        }
+        for (const char *level = filter;; ) {
+            const char *end = strchr(level, '/');
+            size_t length = end ? (size_t)(end - level) : strlen(level);
+            if ((memchr(level, '+', length) || memchr(level, '#', length)) && length != 1) {
+                return false;
+            }
+            if (length == 1 && *level == '#' && end) {
+                return false;
+            }
+            if (!end) {
+                return true;
+            }
+            level = end + 1;
+        }
+    }
+
+    /*
+     * Register a handler for a filter. Returns the filter's node, or NONE when
+     * the filter is invalid or a pool is exhausted (nothing is changed then).
+     */
+    uint16_t add(const char *filter, uint8_t qos, MqttMessageHandler handler, void *context) {
+        if (!validFilter(filter) || freeSubscriptions == NONE) {
+            return NONE;
+        }
+        uint16_t node = root;
+        uint16_t created = NONE; // First node created for this filter, to roll back on exhaustion
+        for (const char *level = filter;; ) {
+            const char *end = strchr(level, '/');
+            size_t length = end ? (size_t)(end - level) : strlen(level);
+            uint16_t child = findChild(node, level, length);
+            if (child == NONE) {
+                child = length < MaxLevelLen ? allocateNode(node, level, length) : NONE;
+                if (child == NONE) {
+                    if (created != NONE) {
+                        prune(created);
+                    }
+                    return NONE;
+                }
+                if (created == NONE) {
+                    created = child;
+                }
+            }
+            node = child;
+            if (!end) {
+                break;
+            }
+            level = end + 1;
+        }
+
+        uint16_t index = freeSubscriptions;
+        Subscription &subscription = subscriptions[index];
+        freeSubscriptions = subscription.next;
+        subscription.qos = qos;
+        subscription.handler = handler;
+        subscription.context = context;
+        subscription.next = nodes[node].subscriptions;
+        nodes[node].subscriptions = index;
+        return node;
+    }
+
+    // Remove every handler of a filter and free the nodes nobody uses any more. Returns false if unknown.
+    bool remove(const char *filter) {
+        uint16_t node = find(filter);
+        if (node == NONE || nodes[node].subscriptions == NONE) {
+            return false;
+        }
+        uint16_t index = nodes[node].subscriptions;
+        while (index != NONE) {
+            uint16_t next = subscriptions[index].next;
+            subscriptions[index].next = freeSubscriptions;
+            freeSubscriptions = index;
+            index = next;
+        }
+        nodes[node].subscriptions = NONE;
+        prune(node);
+        return true;
+    }
+
+    // Node of an exact filter (wildcards compared literally), or NONE
+    uint16_t find(const char *filter) const {
+        uint16_t node = root;
+        for (const char *level = filter;; ) {
+            const char *end = strchr(level, '/');
+            size_t length = end ? (size_t)(end - level) : strlen(level);
+            node = findChild(node, level, length);
+            if (node == NONE || !end) {
+                return node;
+            }
+            level = end + 1;
+        }
+    }
+
+    // Call every handler whose filter matches the topic; returns how many were called
+    size_t dispatch(const MqttInboundMessage &message) const {
+        return match(root, message.topic, message, true);
+    }
+
+    // Highest QoS among the handlers of a node (the QoS to subscribe with)
+    uint8_t qos(uint16_t node) const {
+        uint8_t result = 0;
+        for (uint16_t i = nodes[node].subscriptions; i != NONE; i = subscriptions[i].next) {
+            result = subscriptions[i].qos > result ? subscriptions[i].qos : result;
+        }
+        return result;
+    }
+
+    // Call visit(node, filter) for every filter with handlers, rebuilding the filter text into buffer
+    template <typename Visitor>
+    void forEachFilter(char *buffer, size_t size, Visitor visit) const {
+        for (uint16_t node = 0; node < MaxNodes; node++) {
+            if (node != root && nodes[node].subscriptions != NONE && filterOf(node, buffer, size)) {
+                visit(node, (const char *)buffer);
+            }
+        }
+    }
+
+    // Nodes still available for new filter levels
+    size_t freeNodeCount() const {
+        size_t count = 0;
+        for (uint16_t index = freeNodes; index != NONE; index = nodes[index].nextSibling) {
+            count++;
+        }
+        return count;
+    }
+
+private:
+    struct Node {
+        char level[MaxLevelLen];  // This level of the filter, NUL-terminated
+        uint16_t parent;
+        uint16_t firstChild;
+        uint16_t nextSibling;     // Also links the free list
+        uint16_t subscriptions;   // First handler registered for the filter ending here
+    };
+
+    struct Subscription {
+        MqttMessageHandler handler;
+        void *context;
+        uint16_t next;            // Next handler on the same node, or next free entry
+        uint8_t qos;
+    };
+
+    Node nodes[MaxNodes];
+    Subscription subscriptions[MaxSubscriptions];
+    uint16_t freeNodes;
+    uint16_t freeSubscriptions;
+    uint16_t root;
+
+    uint16_t allocateNode(uint16_t parent, const char *level, size_t length) {
+        if (freeNodes == NONE) {
+            return NONE;
+        }
+        uint16_t index = freeNodes;
+        Node &node = nodes[index];
+        freeNodes = node.nextSibling;
+        memcpy(node.level, level, length);
+        node.level[length] = '\0';
+        node.parent = parent;
+        node.firstChild = NONE;
+        node.subscriptions = NONE;
+        node.nextSibling = NONE;
+        if (parent != NONE) {
+            node.nextSibling = nodes[parent].firstChild;
+            nodes[parent].firstChild = index;
+        }
+        return index;
+    }
+
+    // Free a node without handlers or children, then its parents while they become unused
+    void prune(uint16_t index) {
+        while (index != root && nodes[index].firstChild == NONE && nodes[index].subscriptions == NONE) {
+            uint16_t parent = nodes[index].parent;
+            uint16_t *link = &nodes[parent].firstChild;
+            while (*link != index) {
+                link = &nodes[*link].nextSibling;
+            }
+            *link = nodes[index].nextSibling;
+            nodes[index].parent = NONE;
+            nodes[index].nextSibling = freeNodes;
+            freeNodes = index;
+            index = parent;
+        }
+    }
+
+    uint16_t findChild(uint16_t node, const char *level, size_t length) const {
+        for (uint16_t child = nodes[node].firstChild; child != NONE; child = nodes[child].nextSibling) {
+            if (strncmp(nodes[child].level, level, length) == 0 && nodes[child].level[length] == '\0') {
+                return child;
+            }
+        }
+        return NONE;
+    }
+
+    size_t notify(uint16_t node, const MqttInboundMessage &message) const {
+        size_t called = 0;
+        for (uint16_t i = nodes[node].subscriptions; i != NONE; i = subscriptions[i].next) {
+            subscriptions[i].handler(message, subscriptions[i].context);
+            called++;
+        }
+        return called;
+    }
+
+    // Match the rest of the topic (starting at level) below node
+    size_t match(uint16_t node, const char *level, const MqttInboundMessage &message, bool first) const {
+        const char *end = strchr(level, '/');
+        size_t length = end ? (size_t)(end - level) : strlen(level);
+        bool wildcards = !(first && *level == '$'); // "$SYS/..." is not matched by leading wildcards
+        size_t called = 0;
+        for (uint16_t child = nodes[node].firstChild; child != NONE; child = nodes[child].nextSibling) {
+            const char *name = nodes[child].level;
+            if (name[0] == '#' && name[1] == '\0') {
+                if (wildcards) {
+                    called += notify(child, message); // Matches this level and everything below
+                }
+            } else if ((name[0] == '+' && name[1] == '\0' && wildcards) ||
+                       (strncmp(name, level, length) == 0 && name[length] == '\0')) {
+                if (end) {
+                    called += match(child, end + 1, message, false);
+                } else {
+                    called += notify(child, message) + matchParent(child, message);
+                }
+            }
+        }
+        return called;
+    }
+
+    // "a/#" also matches "a": after the last level, a '#' child of the matched node applies too
+    size_t matchParent(uint16_t node, const MqttInboundMessage &message) const {
+        for (uint16_t child = nodes[node].firstChild; child != NONE; child = nodes[child].nextSibling) {
+            if (nodes[child].level[0] == '#' && nodes[child].level[1] == '\0') {
+                return notify(child, message);
+            }
+        }
+        return 0;
+    }
+
+    // Rebuild the filter text of a node; false if it does not fit
+    bool filterOf(uint16_t node, char *buffer, size_t size) const {
+        size_t length = 0;
+        for (uint16_t i = node; i != root; i = nodes[i].parent) {
+            length += strlen(nodes[i].level) + (nodes[i].parent != root ? 1 : 0);
+        }
+        if (length >= size) {
+            return false;
+        }
+        buffer[length] = '\0';
+        for (uint16_t i = node; i != root; i = nodes[i].parent) {
+            size_t levelLength = strlen(nodes[i].level);
+            length -= levelLength;
+            memcpy(buffer + length, nodes[i].level, levelLength);
+            if (nodes[i].parent != root) {
+                buffer[--length] = '/';
+            }
+        }
+        return true;
+    }
+};
+
+#endif // MQTTTOPICTRIE_H